@@ -1,4 +1,5 @@
 #include <IOKit/IOLib.h>
+#include <IOKit/IOUserClient.h>
 #include <IOKit/usb/IOUSBDevice.h>
 #include <IOKit/usb/IOUSBInterface.h>
 
@@ -7,6 +8,66 @@ namespace HID_DS4 {
 }
 
 #include "DS4.h"
+#include "DS4HistoryClient.h"
+
+// Enough buffers for the interrupt reads kept in flight plus queued output.
+#define kDS4ReportBufferCount	16
+
+// Interrupt reads kept queued on the pipe, so the pad never waits on the
+// work loop for somewhere to put a report.
+#define kDS4ReadsInFlight		4
+
+// Longest coalescing window accepted, one report period of a 250 Hz pad.
+#define kDS4MaxCoalesceUS		4000
+
+// A failed read backs off before the pipe is cleared and reading resumes,
+// doubling each time it fails again, and reading stops after the last retry.
+#define kDS4ReadRetryMS			10
+#define kDS4ReadRetries			5
+
+// Automatic flight recorder triggers are ignored for a while after one
+// fires, so a pad that keeps glitching does not dump continuously. Latency
+// triggers on a gap of several report periods; loss on the report counter
+// skipping more than a few reports.
+#define kDS4FlightHoldoffMS		10000
+#define kDS4FlightGapPeriods	8
+#define kDS4FlightMaxLoss		4
+#define kDS4FlightDefaultChord	(kDS4ButtonShare | kDS4ButtonTouchpad)
+
+// Frame sync takes display clocks from 500 Hz down to 1 Hz. Unless the
+// client says otherwise, frames are sampled this many half report periods
+// behind the frame time, so a report running late still has one after it.
+#define kDS4FrameMinPeriodNS	2000000ULL
+#define kDS4FrameMaxPeriodNS	1000000000ULL
+#define kDS4FrameDelayHalves	3
+
+// Registry readers get a counters snapshot at most this often.
+#define kDS4CountersRefreshMS	250
+
+// How long a pad waits for DS4Service to come up before starting without it.
+#define kDS4ServiceWaitNS		(100 * 1000 * 1000ULL)
+
+// Control transfers give up after this long, so a wedged pad cannot hold
+// up matching or a feature batch.
+#define kDS4ControlTimeoutMS	500
+
+// Feature transfers of one batch kept queued on the control pipe at once.
+#define kDS4FeaturesInFlight	3
+
+// Every feature report the pad declares fits in one full speed packet.
+#define kDS4MaxFeatureLength	64
+
+// A stick whose rest position is further than this from the centre, in stick
+// units, is flagged as drifting in the wear snapshot.
+#define kDS4WearDriftLimit		16
+
+// Tries of each pairing transfer before the pad is given up on.
+#define kDS4PairingRetries		2
+
+enum {
+	kHIDRequestGetReport	= 0x01,
+	kHIDRequestSetReport	= 0x09
+};
 
 // This required macro defines the class's constructors, destructors,
 // and several other methods I/O Kit requires.
@@ -21,12 +82,120 @@ bool SonyPlaystationDualShock4::init(OSDictionary *dict)
 	
 	IOLog("DS4 Initializing\n");
 	
+	fVariant = NULL;
+	fDecode = NULL;
+	fReportMode = &DS4ReportModes[kDS4ReportModeNative];
+	fModeReport = NULL;
+	fModeBytes = NULL;
+	fPayloadOffset = 0;
+	bzero(&fState, sizeof(fState));
+	fDevice = NULL;
+	fInterface = NULL;
+	fService = NULL;
+	bzero(&fIdentity, sizeof(fIdentity));
+	fReportSequence = 0;
+	fTrace = NULL;
+	fTraceEnabled = false;
+	fCounters.reset();
+	fCountersPublished = 0;
+	fGestures.reset();
+	fGesturesEnabled = false;
+	fMotion.reset();
+	fMotionEnabled = false;
+	fTrackpad.reset();
+	fTrackpadEnabled = false;
+	fPointerCollection = false;
+	fPointerReport = NULL;
+	fZones[0].configure(kDS4TouchZonesNone, false);
+	fZonesActive = 0;
+	fWear = NULL;
+	fWearEnabled = false;
+	fHistoryMemory = NULL;
+	fHistory = NULL;
+	fHistoryEnabled = false;
+	fOutput.reset(kDS4TransportUSB);
+	fOutputLock = NULL;
+	fReportQueue.reset();
+	fInterruptPipe = NULL;
+	fReportSource = NULL;
+	fCoalesceTimer = NULL;
+	fCoalesceUS = 0;
+	fReadsInFlight = 0;
+	fReadRetryTimer = NULL;
+	fReadErrors = 0;
+	fReadRetryPending = 0;
+	fReading = false;
+	fFlight = NULL;
+	fFlightCall = NULL;
+	fFlightPending = kDS4FlightTriggerNone;
+	fFlightLastAutomatic = 0;
+	bzero(&fPairPad, sizeof(fPairPad));
+	bzero(&fPairRequest, sizeof(fPairRequest));
+	fPairingBusy = 0;
+	bzero(&fBatch, sizeof(fBatch));
+	bzero(fBatchRequests, sizeof(fBatchRequests));
+	fBatchAction = NULL;
+	fBatchContext = NULL;
+	fBatchBusy = 0;
+	fBatchLock = NULL;
+	fResampler = NULL;
+	fFrameTimer = NULL;
+	fFrameReport = NULL;
+	fFrameLock = NULL;
+	fFrameNext = 0;
+	fFrameSync = false;
+	
 	return result;
 }
 
 void SonyPlaystationDualShock4::free(void)
 {
 	IOLog("DS4 Freeing\n");
+	
+	if (fTrace != NULL) {
+		IOFree(fTrace, sizeof(DS4TraceBuffer));
+		fTrace = NULL;
+	}
+	
+	if (fWear != NULL) {
+		IOFree(fWear, sizeof(DS4WearHistograms));
+		fWear = NULL;
+	}
+	
+	fHistory = NULL;
+	OSSafeReleaseNULL(fHistoryMemory);
+	
+	if (fOutputLock != NULL) {
+		IOLockFree(fOutputLock);
+		fOutputLock = NULL;
+	}
+	
+	if (fBatchLock != NULL) {
+		IOLockFree(fBatchLock);
+		fBatchLock = NULL;
+	}
+	
+	if (fFrameLock != NULL) {
+		IOLockFree(fFrameLock);
+		fFrameLock = NULL;
+	}
+	
+	if (fResampler != NULL) {
+		IOFree(fResampler, sizeof(DS4FrameResampler));
+		fResampler = NULL;
+	}
+	
+	// A pending dump holds a reference, so none can be running by now.
+	if (fFlightCall != NULL) {
+		thread_call_free(fFlightCall);
+		fFlightCall = NULL;
+	}
+	
+	if (fFlight != NULL) {
+		IOFree(fFlight, sizeof(DS4FlightRecorder));
+		fFlight = NULL;
+	}
+	
 	super::free();
 }
 
@@ -35,37 +204,1797 @@ IOService *SonyPlaystationDualShock4::probe(IOService *provider,
 {
 	IOService *result = IOHIDDevice::probe(provider, score);
 	IOLog("DS4 Probing\n");
+	
+	IOUSBDevice *device = OSDynamicCast(IOUSBDevice, provider);
+	if (device == NULL)
+		return NULL;
+	
+	fVariant = DS4LookupVariant(device->GetVendorID(), device->GetProductID());
+	if (fVariant == NULL) {
+		IOLog("DS4 Unsupported device %04x:%04x\n", device->GetVendorID(), device->GetProductID());
+		return NULL;
+	}
+	
+	IOLog("DS4 Matched %s\n", fVariant->name);
+	setProperty("DS4Variant", fVariant->name);
+	
 	return result;
 }
 
 bool SonyPlaystationDualShock4::start(IOService *provider)
 {
+	// Pick the decoder before the HID stack can deliver the first report.
+	// probe only accepts USB providers, so reports always use USB framing.
+	fDecode = DS4SelectDecoder(kDS4TransportUSB, (DS4Variant)fVariant->variant);
+	fPayloadOffset = DS4TransportTraits<kDS4TransportUSB>::kPayload;
+	
+	// Size the report buffers for the largest report either the descriptor or
+	// the output framing can produce, then allocate them all up front.
+	if (!DS4ParseReportSizes(HID_DS4::ReportDescriptor, sizeof(HID_DS4::ReportDescriptor), &fReportSizes))
+		return false;
+	
+	UInt32 bufferSize = max(fReportSizes.largest, (UInt32)DS4OutputLayouts[kDS4TransportUSB].length);
+	
+	if (!fReportPool.init(bufferSize, kDS4ReportBufferCount)) {
+		IOLog("DS4 Could not allocate report buffers\n");
+		return false;
+	}
+	
+	fOutput.reset(kDS4TransportUSB);
+	if ((fOutputLock == NULL && (fOutputLock = IOLockAlloc()) == NULL) ||
+		(fBatchLock == NULL && (fBatchLock = IOLockAlloc()) == NULL)) {
+		fReportPool.free();
+		return false;
+	}
+	
+	if (!openInterface(provider)) {
+		releaseResources();
+		return false;
+	}
+	
+	// Identity comes from DS4Service's cache when this pad has been seen before.
+	OSDictionary *matching = serviceMatching("DS4Service");
+	if (matching != NULL) {
+		IOService *service = waitForMatchingService(matching, kDS4ServiceWaitNS);
+		fService = OSDynamicCast(DS4Service, service);
+		if (fService == NULL && service != NULL)
+			service->release();
+		matching->release();
+	}
+	readIdentity();
+	
+	OSBoolean *trace = OSDynamicCast(OSBoolean, getProperty(kDS4TraceEnabledKey));
+	if (trace != NULL && trace->isTrue())
+		setTraceEnabled(true);
+	
+	OSBoolean *gestures = OSDynamicCast(OSBoolean, getProperty(kDS4TouchGesturesKey));
+	if (gestures != NULL && gestures->isTrue())
+		setGesturesEnabled(true);
+	
+	OSBoolean *motion = OSDynamicCast(OSBoolean, getProperty(kDS4MotionGesturesKey));
+	if (motion != NULL && motion->isTrue())
+		setMotionGesturesEnabled(true);
+	
+	OSBoolean *wear = OSDynamicCast(OSBoolean, getProperty(kDS4WearEnabledKey));
+	if (wear != NULL && wear->isTrue())
+		setWearEnabled(true);
+	
+	OSObject *zones = getProperty(kDS4TouchZonesKey);
+	OSBoolean *zonesClick = OSDynamicCast(OSBoolean, getProperty(kDS4TouchZonesClickKey));
+	if (zones != NULL)
+		setTouchZones(zones, zonesClick != NULL && zonesClick->isTrue());
+	
+	// Like the pointer collection below, the report layout is fixed once the HID
+	// stack has read the descriptor.
+	OSString *mode = OSDynamicCast(OSString, getProperty(kDS4ReportModeKey));
+	const DS4ReportModeInfo *info = (mode != NULL) ? DS4LookupReportMode(mode->getCStringNoCopy()) : NULL;
+	if (mode != NULL && info == NULL)
+		IOLog("DS4 Unknown report mode %s\n", mode->getCStringNoCopy());
+	
+	if (info != NULL && info->reportLength != 0) {
+		fModeReport = IOBufferMemoryDescriptor::inTaskWithOptions(kernel_task, 0, info->reportLength);
+		if (fModeReport != NULL) {
+			fModeBytes = (UInt8 *)fModeReport->getBytesNoCopy();
+		} else {
+			IOLog("DS4 Could not allocate %s reports\n", info->name);
+			info = NULL;
+		}
+	}
+	if (info != NULL)
+		fReportMode = info;
+	setProperty(kDS4ReportModeKey, fReportMode->name);
+	
+	// How many elements the HID stack will build for the published layout.
+	DS4ReportSizes *published = (DS4ReportSizes *)IOMalloc(sizeof(DS4ReportSizes));
+	if (published != NULL) {
+		if (DS4ParseReportSizes(fReportMode->descriptor, fReportMode->descriptorLength, published)) {
+			IOLog("DS4 %s descriptor, %u elements (native %u)\n",
+				  fReportMode->name, published->elements, fReportSizes.elements);
+			setProperty("DS4ReportElements", published->elements, 32);
+		}
+		IOFree(published, sizeof(DS4ReportSizes));
+	}
+	
+	// The pointer collection has to be in the descriptor before the HID stack
+	// reads it, so it is only offered when the mode is asked for at start.
+	OSBoolean *trackpad = OSDynamicCast(OSBoolean, getProperty(kDS4TrackpadKey));
+	if (trackpad != NULL && trackpad->isTrue()) {
+		fPointerReport = IOBufferMemoryDescriptor::inTaskWithOptions(kernel_task, 0, kDS4PointerReportLength);
+		if (fPointerReport != NULL) {
+			fPointerCollection = true;
+			setTrackpadEnabled(true);
+		} else {
+			IOLog("DS4 Could not allocate pointer report\n");
+		}
+	}
+	
+	OSNumber *window = OSDynamicCast(OSNumber, getProperty(kDS4CoalesceWindowKey));
+	setCoalesceWindow(window != NULL ? window->unsigned32BitValue() : 0);
+	
+	startFlightRecorder();
+	
 	bool result = IOHIDDevice::start(provider);
 	IOLog("DS4 Starting\n");
+	
+	// Reports can only be delivered once the HID stack is up.
+	if (result && !startReading()) {
+		super::stop(provider);
+		result = false;
+	}
+	if (result)
+		startFrameSync();
+	
+	if (!result)
+		releaseResources();
+	
 	return result;
 }
 
 void SonyPlaystationDualShock4::stop(IOService *provider)
 {
 	IOLog("DS4 Stopping\n");
+	stopFrameSync();
+	stopReading();
 	super::stop(provider);
+	
+	releaseResources();
+}
+
+// Configures the pad and opens its HID interface so class requests can be
+// sent to it.
+bool SonyPlaystationDualShock4::openInterface(IOService *provider)
+{
+	fDevice = OSDynamicCast(IOUSBDevice, provider);
+	if (fDevice == NULL)
+		return false;
+	
+	if (!fDevice->open(this)) {
+		IOLog("DS4 Could not open device\n");
+		fDevice = NULL;
+		return false;
+	}
+	
+	const IOUSBConfigurationDescriptor *config = fDevice->GetFullConfigurationDescriptor(0);
+	if (config == NULL || fDevice->SetConfiguration(this, config->bConfigurationValue) != kIOReturnSuccess) {
+		IOLog("DS4 Could not configure device\n");
+		return false;
+	}
+	
+	IOUSBFindInterfaceRequest request;
+	request.bInterfaceClass = kUSBHIDInterfaceClass;
+	request.bInterfaceSubClass = kIOUSBFindInterfaceDontCare;
+	request.bInterfaceProtocol = kIOUSBFindInterfaceDontCare;
+	request.bAlternateSetting = kIOUSBFindInterfaceDontCare;
+	
+	fInterface = fDevice->FindNextInterface(NULL, &request);
+	if (fInterface == NULL || !fInterface->open(this)) {
+		IOLog("DS4 Could not open HID interface\n");
+		fInterface = NULL;
+		return false;
+	}
+	
+	return true;
+}
+
+void SonyPlaystationDualShock4::releaseResources(void)
+{
+	if (fInterface != NULL) {
+		fInterface->close(this);
+		fInterface = NULL;
+	}
+	
+	if (fDevice != NULL) {
+		fDevice->close(this);
+		fDevice = NULL;
+	}
+	
+	OSSafeReleaseNULL(fService);
+	OSSafeReleaseNULL(fPointerReport);
+	OSSafeReleaseNULL(fModeReport);
+	fModeBytes = NULL;
+	fReportPool.free();
+}
+
+// Fills in a class GET_REPORT or SET_REPORT for the HID interface. The
+// length is checked against what the report descriptor declares for the ID:
+// a read needs room for the whole report, a write must be exactly that long
+// and start with the ID.
+IOReturn SonyPlaystationDualShock4::makeControlRequest(UInt8 direction, DS4ReportKind kind, UInt8 reportID,
+													   UInt8 *buffer, UInt16 length, IOUSBDevRequest *request)
+{
+	if (fInterface == NULL)
+		return kIOReturnNotOpen;
+	
+	UInt16 size = DS4ReportSize(&fReportSizes, kind, reportID);
+	if (size == 0 || length < size || (direction == kUSBOut && length != size))
+		return kIOReturnBadArgument;
+	
+	request->bmRequestType = USBmakebmRequestType(direction, kUSBClass, kUSBInterface);
+	request->bRequest = (direction == kUSBIn) ? kHIDRequestGetReport : kHIDRequestSetReport;
+	request->wValue = (UInt16)((kind + 1) << 8 | reportID);
+	request->wIndex = fInterface->GetInterfaceNumber();
+	request->wLength = size;
+	request->pData = buffer;
+	request->wLenDone = 0;
+	
+	return kIOReturnSuccess;
+}
+
+// Synchronous GET_REPORT on the control pipe.
+IOReturn SonyPlaystationDualShock4::getFeatureReport(UInt8 reportID, UInt8 *buffer, UInt16 length)
+{
+	IOUSBDevRequest request;
+	IOReturn result = makeControlRequest(kUSBIn, kDS4ReportKindFeature, reportID, buffer, length, &request);
+	if (result != kIOReturnSuccess)
+		return result;
+	
+	result = fDevice->DeviceRequest(&request, kDS4ControlTimeoutMS, kDS4ControlTimeoutMS);
+	if (result == kIOReturnSuccess && request.wLenDone < request.wLength)
+		result = kIOReturnUnderrun;
+	
+	return result;
+}
+
+// SET_REPORT counterpart of getFeatureReport, for feature and output reports.
+IOReturn SonyPlaystationDualShock4::setControlReport(DS4ReportKind kind, UInt8 reportID, const UInt8 *buffer, UInt16 length)
+{
+	IOUSBDevRequest request;
+	IOReturn result = makeControlRequest(kUSBOut, kind, reportID, (UInt8 *)buffer, length, &request);
+	if (result != kIOReturnSuccess)
+		return result;
+	
+	return fDevice->DeviceRequest(&request, kDS4ControlTimeoutMS, kDS4ControlTimeoutMS);
+}
+
+// Reads the pad address, calibration and firmware block in one batch, so
+// they share the control pipe rather than waiting on each other. The cache is
+// keyed by the address, which is only known once the batch is back, so the
+// firmware block is always read and only used when DS4Service has not seen
+// the pad before.
+void SonyPlaystationDualShock4::readIdentity(void)
+{
+	UInt8 pairing[kDS4PairingInfoLength], calibration[kDS4CalibrationLength], firmware[kDS4FirmwareInfoLength];
+	DS4FeatureOp ops[3];
+	DS4DeviceIdentity fresh;
+	
+	bzero(ops, sizeof(ops));
+	ops[0].reportID = kDS4FeaturePairingInfo;
+	ops[0].buffer = pairing;
+	ops[0].length = sizeof(pairing);
+	ops[1].reportID = kDS4FeatureCalibration;
+	ops[1].buffer = calibration;
+	ops[1].length = sizeof(calibration);
+	ops[2].reportID = kDS4FeatureFirmwareInfo;
+	ops[2].buffer = firmware;
+	ops[2].length = sizeof(firmware);
+	for (int i = 0; i < 3; i++) {
+		ops[i].direction = kDS4FeatureGet;
+		ops[i].status = kIOReturnNotReady;
+	}
+	
+	IOReturn result = runFeaturesSync(ops, 3);
+	if (result != kIOReturnSuccess)
+		IOLog("DS4 Attach feature reads failed: 0x%08x\n", result);
+	
+	bzero(&fresh, sizeof(fresh));
+	if (ops[0].status == kIOReturnSuccess)
+		DS4DecodePairingInfo(pairing, ops[0].transferred, &fresh);
+	if (!(fresh.flags & kDS4IdentityHasMAC) &&
+		getFeatureReport(kDS4FeatureMACAddress, pairing, sizeof(pairing)) == kIOReturnSuccess)
+		DS4DecodeMACAddress(pairing, kDS4MACAddressLength, &fresh);
+	
+	if (!(fresh.flags & kDS4IdentityHasMAC)) {
+		IOLog("DS4 Could not read pad address\n");
+		return;
+	}
+	
+	if (ops[1].status == kIOReturnSuccess) {
+		OSData *data = OSData::withBytes(calibration, ops[1].transferred);
+		if (data != NULL) {
+			setProperty("DS4Calibration", data);
+			data->release();
+		}
+	}
+	
+	if (fService != NULL && fService->copyIdentity(fresh.mac, &fIdentity) &&
+		(fIdentity.flags & kDS4IdentityHasFirmware)) {
+		fCounters.add(kDS4CounterFeatureCacheHits);
+		
+		// The pairing may have changed since the pad was cached.
+		memcpy(fIdentity.hostMAC, fresh.hostMAC, sizeof(fIdentity.hostMAC));
+		fIdentity.flags |= fresh.flags;
+	} else {
+		fCounters.add(kDS4CounterFeatureCacheMisses);
+		
+		fIdentity = fresh;
+		if (ops[2].status == kIOReturnSuccess)
+			DS4DecodeFirmwareInfo(firmware, ops[2].transferred, &fIdentity);
+	}
+	
+	if (fService != NULL)
+		fService->storeIdentity(&fIdentity);
+	
+	publishIdentity();
+}
+
+void SonyPlaystationDualShock4::publishIdentity(void)
+{
+	char mac[18];
+	
+	DS4FormatMAC(fIdentity.mac, mac);
+	setProperty("DS4MACAddress", mac);
+	
+	if (fIdentity.flags & kDS4IdentityHasHostMAC) {
+		DS4FormatMAC(fIdentity.hostMAC, mac);
+		setProperty("DS4PairedHostAddress", mac);
+	}
+	
+	if (fIdentity.flags & kDS4IdentityHasFirmware) {
+		setProperty("DS4HardwareVersion", fIdentity.hardwareVersion, 16);
+		setProperty("DS4FirmwareVersion", fIdentity.firmwareVersion, 16);
+		setProperty("DS4FirmwareBuildDate", fIdentity.buildDate);
+		setProperty("DS4FirmwareBuildTime", fIdentity.buildTime);
+	}
 }
 
 IOReturn SonyPlaystationDualShock4::newReportDescriptor(IOMemoryDescriptor **descriptor) const
 {
 	IOLog("DS4 In report descriptor\n");
+	IOByteCount length = fReportMode->descriptorLength;
+	if (fPointerCollection)
+		length += sizeof(HID_DS4::PointerReportDescriptor);
+	
 	IOBufferMemoryDescriptor *buffer = IOBufferMemoryDescriptor::inTaskWithOptions(
 																				   kernel_task,
 																				   0,
-																				   sizeof(HID_DS4::ReportDescriptor)
+																				   length
 																				   );
 	
 	if (buffer == NULL)
 		return kIOReturnNoResources;
 	
-	buffer->writeBytes(0, HID_DS4::ReportDescriptor,sizeof(HID_DS4::ReportDescriptor));
+	buffer->writeBytes(0, fReportMode->descriptor, fReportMode->descriptorLength);
+	if (fPointerCollection)
+		buffer->writeBytes(fReportMode->descriptorLength, HID_DS4::PointerReportDescriptor, sizeof(HID_DS4::PointerReportDescriptor));
 	
 	*descriptor = buffer;
 	
 	return kIOReturnSuccess;
-}
\ No newline at end of file
+}
+
+IOReturn SonyPlaystationDualShock4::handleReport(IOMemoryDescriptor *report,
+												 IOHIDReportType reportType,
+												 IOOptionBits options)
+{
+	if (reportType != kIOHIDReportTypeInput)
+		return super::handleReport(report, reportType, options);
+	
+	UInt64 arrival;
+	clock_get_uptime(&arrival);
+	return handleInputReport(report, arrival, options);
+}
+
+// Everything downstream is stamped with arrival, when the read completed,
+// rather than when the work loop got to the report.
+IOReturn SonyPlaystationDualShock4::handleInputReport(IOMemoryDescriptor *report, UInt64 arrival, IOOptionBits options)
+{
+	bool tracing = __atomic_load_n(&fTraceEnabled, __ATOMIC_ACQUIRE);
+	bool touchGestures = __atomic_load_n(&fGesturesEnabled, __ATOMIC_ACQUIRE);
+	bool motionGestures = __atomic_load_n(&fMotionEnabled, __ATOMIC_ACQUIRE);
+	bool wear = __atomic_load_n(&fWearEnabled, __ATOMIC_ACQUIRE);
+	bool history = __atomic_load_n(&fHistoryEnabled, __ATOMIC_ACQUIRE);
+	UInt16 sequence = __atomic_load_n(&fReportSequence, __ATOMIC_RELAXED);
+	UInt64 arrivalNS, decoded = 0, dispatched = 0;
+	
+	// Only the report path writes it; writeOutput reads it for its spans.
+	__atomic_store_n(&fReportSequence, (UInt16)(sequence + 1), __ATOMIC_RELAXED);
+	absolutetime_to_nanoseconds(arrival, &arrivalNS);
+	fCounters.add(kDS4CounterReportsReceived);
+	
+	UInt8 bytes[DS4TransportTraits<kDS4TransportBluetooth>::kReportLength];
+	IOByteCount length = report->readBytes(0, bytes, sizeof(bytes));
+	
+	if (fFlight != NULL)
+		fFlight->record(kDS4CaptureInput, bytes, length, arrival);
+	
+	DS4DecodeResult decodeResult = fDecode(bytes, length, &fState);
+	switch (decodeResult) {
+		case kDS4DecodeOK:
+			fCounters.add(kDS4CounterReportsDecoded);
+			if (fFlight != NULL) {
+				DS4FlightTrigger trigger = fFlight->check(&fState, arrival);
+				if (trigger != kDS4FlightTriggerNone)
+					triggerFlightDump(trigger, arrival);
+			}
+			if (touchGestures)
+				fGestures.process(&fState, arrivalNS);
+			if (motionGestures)
+				fMotion.process(&fState, arrivalNS);
+			if (wear)
+				fWear->record(&fState, arrivalNS);
+			if (history)
+				fHistory->record(&fState, arrivalNS);
+			fZones[__atomic_load_n(&fZonesActive, __ATOMIC_ACQUIRE)].process(&fState);
+			break;
+		case kDS4DecodeIgnored:
+			break;
+		case kDS4DecodeBadCRC:
+			fCounters.add(kDS4CounterCRCFailures);
+			// fall through
+		case kDS4DecodeTruncated:
+			fCounters.add(kDS4CounterReportsDropped);
+			return kIOReturnSuccess;
+	}
+	
+	if (tracing)
+		clock_get_uptime(&decoded);
+	
+	// Other layouts are written straight into their own preallocated report,
+	// which is what the HID stack sees in place of the pad's. Reports without
+	// pad data have nothing to translate. With frame sync on, pad data only
+	// reaches the HID stack through deliverFrame.
+	IOReturn result = kIOReturnSuccess;
+	if (decodeResult == kDS4DecodeOK && __atomic_load_n(&fFrameSync, __ATOMIC_ACQUIRE)) {
+		IOLockLock(fFrameLock);
+		fResampler->push(bytes, length, arrivalNS);
+		IOLockUnlock(fFrameLock);
+		fCounters.add(kDS4CounterReportsSuppressed);
+	} else if (fModeBytes == NULL) {
+		result = super::handleReportWithTime(arrival, report, kIOHIDReportTypeInput, options);
+	} else if (decodeResult == kDS4DecodeOK) {
+		fReportMode->translate(bytes + fPayloadOffset, fModeBytes);
+		result = super::handleReportWithTime(arrival, fModeReport, kIOHIDReportTypeInput, options);
+	}
+	
+	if (__atomic_load_n(&fTrackpadEnabled, __ATOMIC_ACQUIRE))
+		dispatchPointer();
+	
+	if (tracing) {
+		clock_get_uptime(&dispatched);
+		fTrace->record(kDS4TraceArrival, arrival, arrival, sequence);
+		fTrace->record(kDS4TraceDecode, arrival, decoded, sequence);
+		fTrace->record(kDS4TraceDispatch, decoded, dispatched, sequence);
+	}
+	
+	return result;
+}
+
+// Feature reports go straight to the pad, checked against the native
+// descriptor rather than the published one. This is how the vendor feature
+// reports left out of the compact descriptor stay reachable.
+IOReturn SonyPlaystationDualShock4::getReport(IOMemoryDescriptor *report,
+											  IOHIDReportType reportType,
+											  IOOptionBits options)
+{
+	if (reportType != kIOHIDReportTypeFeature)
+		return super::getReport(report, reportType, options);
+	
+	UInt8 reportID = (UInt8)(options & 0xFF);
+	UInt16 size = DS4ReportSize(&fReportSizes, kDS4ReportKindFeature, reportID);
+	UInt8 buffer[kDS4MaxFeatureLength];
+	
+	if (size == 0 || size > sizeof(buffer) || report->getLength() < size)
+		return kIOReturnBadArgument;
+	
+	IOReturn result = getFeatureReport(reportID, buffer, size);
+	if (result == kIOReturnSuccess)
+		report->writeBytes(0, buffer, size);
+	
+	return result;
+}
+
+// Output reports from clients are merged into the shadow rather than sent as
+// they are, so they only override the fields they flag and do not undo what
+// was set through the properties.
+IOReturn SonyPlaystationDualShock4::setReport(IOMemoryDescriptor *report,
+											  IOHIDReportType reportType,
+											  IOOptionBits options)
+{
+	UInt8 reportID = (UInt8)(options & 0xFF);
+	
+	if (reportType == kIOHIDReportTypeOutput && reportID == DS4OutputLayouts[kDS4TransportUSB].reportID) {
+		UInt8 buffer[kDS4OutputPayloadLength + 1];
+		IOByteCount length = report->readBytes(0, buffer, sizeof(buffer));
+		if (length < 2)
+			return kIOReturnBadArgument;
+		
+		IOLockLock(fOutputLock);
+		fOutput.merge(buffer + 1, length - 1);
+		IOReturn result = writeOutput();
+		IOLockUnlock(fOutputLock);
+		return result;
+	}
+	
+	if (reportType != kIOHIDReportTypeFeature)
+		return super::setReport(report, reportType, options);
+	
+	UInt16 size = DS4ReportSize(&fReportSizes, kDS4ReportKindFeature, reportID);
+	UInt8 buffer[kDS4MaxFeatureLength];
+	
+	if (size == 0 || size > sizeof(buffer) || report->readBytes(0, buffer, size) != size)
+		return kIOReturnBadArgument;
+	
+	buffer[0] = reportID;
+	return setControlReport(kDS4ReportKindFeature, reportID, buffer, size);
+}
+
+// Reads an array of exactly count numbers, each 0 - 255.
+static bool CopyBytes(OSObject *object, UInt8 *out, unsigned count)
+{
+	OSArray *array = OSDynamicCast(OSArray, object);
+	if (array == NULL || array->getCount() != count)
+		return false;
+	
+	for (unsigned i = 0; i < count; i++) {
+		OSNumber *value = OSDynamicCast(OSNumber, array->getObject(i));
+		if (value == NULL || value->unsigned32BitValue() > 0xFF)
+			return false;
+		out[i] = value->unsigned8BitValue();
+	}
+	
+	return true;
+}
+
+IOReturn SonyPlaystationDualShock4::setProperties(OSObject *properties)
+{
+	OSDictionary *dict = OSDynamicCast(OSDictionary, properties);
+	if (dict == NULL)
+		return kIOReturnBadArgument;
+	
+	OSBoolean *trace = OSDynamicCast(OSBoolean, dict->getObject(kDS4TraceEnabledKey));
+	if (trace != NULL)
+		setTraceEnabled(trace->isTrue());
+	
+	if (dict->getObject(kDS4TraceSnapshotKey) != NULL)
+		publishTrace();
+	
+	OSBoolean *gestures = OSDynamicCast(OSBoolean, dict->getObject(kDS4TouchGesturesKey));
+	if (gestures != NULL)
+		setGesturesEnabled(gestures->isTrue());
+	
+	OSBoolean *motion = OSDynamicCast(OSBoolean, dict->getObject(kDS4MotionGesturesKey));
+	if (motion != NULL)
+		setMotionGesturesEnabled(motion->isTrue());
+	
+	OSBoolean *wear = OSDynamicCast(OSBoolean, dict->getObject(kDS4WearEnabledKey));
+	if (wear != NULL)
+		setWearEnabled(wear->isTrue());
+	
+	if (dict->getObject(kDS4WearSnapshotKey) != NULL)
+		publishWear();
+	
+	OSBoolean *history = OSDynamicCast(OSBoolean, dict->getObject(kDS4InputHistoryKey));
+	if (history != NULL)
+		setHistoryEnabled(history->isTrue());
+	
+	// Every field set here goes out together in one report.
+	UInt8 values[3];
+	bool output = false;
+	if (CopyBytes(dict->getObject(kDS4RumbleKey), values, 2)) {
+		setRumble(values[0], values[1]);
+		output = true;
+	}
+	if (CopyBytes(dict->getObject(kDS4LightBarKey), values, 3)) {
+		setLightBar(values[0], values[1], values[2]);
+		output = true;
+	}
+	if (CopyBytes(dict->getObject(kDS4LightBarFlashKey), values, 2)) {
+		setLightBarFlash(values[0], values[1]);
+		output = true;
+	}
+	if (output)
+		flushOutput();
+	
+	OSDictionary *pair = OSDynamicCast(OSDictionary, dict->getObject(kDS4PairKey));
+	if (pair != NULL) {
+		if (IOUserClient::clientHasPrivilege(current_task(), kIOClientPrivilegeAdministrator) != kIOReturnSuccess)
+			return kIOReturnNotPrivileged;
+		
+		IOReturn result = startPairing(pair);
+		if (result != kIOReturnSuccess)
+			return result;
+	}
+	
+	if (dict->getObject(kDS4FlightDumpKey) != NULL) {
+		if (fFlight == NULL)
+			return kIOReturnNotReady;
+		UInt64 now;
+		clock_get_uptime(&now);
+		triggerFlightDump(kDS4FlightTriggerRequest, now);
+	}
+	
+	OSNumber *window = OSDynamicCast(OSNumber, dict->getObject(kDS4CoalesceWindowKey));
+	if (window != NULL)
+		setCoalesceWindow(window->unsigned32BitValue());
+	
+	OSObject *frameSync = dict->getObject(kDS4FrameSyncKey);
+	if (frameSync != NULL) {
+		IOReturn result = setFrameSync(frameSync);
+		if (result != kIOReturnSuccess)
+			return result;
+	}
+	
+	OSBoolean *trackpad = OSDynamicCast(OSBoolean, dict->getObject(kDS4TrackpadKey));
+	if (trackpad != NULL)
+		setTrackpadEnabled(trackpad->isTrue());
+	
+	OSObject *zones = dict->getObject(kDS4TouchZonesKey);
+	OSBoolean *zonesClick = OSDynamicCast(OSBoolean, dict->getObject(kDS4TouchZonesClickKey));
+	if (zones != NULL || zonesClick != NULL) {
+		if (zones == NULL)
+			zones = getProperty(kDS4TouchZonesKey);
+		if (zonesClick == NULL)
+			zonesClick = OSDynamicCast(OSBoolean, getProperty(kDS4TouchZonesClickKey));
+		
+		if (!setTouchZones(zones, zonesClick != NULL && zonesClick->isTrue()))
+			return kIOReturnBadArgument;
+	}
+	
+	return kIOReturnSuccess;
+}
+
+// Refreshes the counters snapshot before the registry serializes our
+// properties, at most every kDS4CountersRefreshMS. The report path only ever
+// touches fCounters, so reading statistics never contends with it.
+bool SonyPlaystationDualShock4::serializeProperties(OSSerialize *serialize) const
+{
+	const_cast<SonyPlaystationDualShock4 *>(this)->publishCounters();
+	return super::serializeProperties(serialize);
+}
+
+void SonyPlaystationDualShock4::publishCounters(void)
+{
+	UInt64 now, interval;
+	
+	clock_get_uptime(&now);
+	nanoseconds_to_absolutetime(kDS4CountersRefreshMS * 1000000ULL, &interval);
+	
+	UInt64 last = __atomic_load_n(&fCountersPublished, __ATOMIC_RELAXED);
+	if (last != 0 && now - last < interval)
+		return;
+	if (!__atomic_compare_exchange_n(&fCountersPublished, &last, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		return;
+	
+	OSDictionary *snapshot = OSDictionary::withCapacity(kDS4CounterCount + 1);
+	if (snapshot == NULL)
+		return;
+	
+	for (int i = 0; i < kDS4CounterCount; i++) {
+		OSNumber *value = OSNumber::withNumber(fCounters.get((DS4Counter)i), 64);
+		if (value != NULL) {
+			snapshot->setObject(DS4CounterNames[i], value);
+			value->release();
+		}
+	}
+	
+	OSNumber *exhausted = OSNumber::withNumber(fReportPool.exhaustedCount(), 32);
+	if (exhausted != NULL) {
+		snapshot->setObject("ReportBuffersExhausted", exhausted);
+		exhausted->release();
+	}
+	
+	setProperty(kDS4CountersKey, snapshot);
+	snapshot->release();
+}
+
+// The trace buffer is allocated the first time tracing is turned on and kept
+// until the device is freed, so the report path never sees it go away.
+void SonyPlaystationDualShock4::setTraceEnabled(bool enabled)
+{
+	if (enabled && fTrace == NULL) {
+		DS4TraceBuffer *buffer = (DS4TraceBuffer *)IOMalloc(sizeof(DS4TraceBuffer));
+		if (buffer == NULL)
+			return;
+		
+		buffer->reset();
+		fTrace = buffer;
+	}
+	
+	__atomic_store_n(&fTraceEnabled, enabled, __ATOMIC_RELEASE);
+	setProperty(kDS4TraceEnabledKey, enabled);
+}
+
+// Converts the ring to the export format in nanoseconds and publishes it as
+// the DS4Trace property, for tools/ds4trace to turn into a Chrome trace.
+void SonyPlaystationDualShock4::publishTrace(void)
+{
+	if (fTrace == NULL)
+		return;
+	
+	const size_t eventsSize = kDS4TraceCapacity * sizeof(DS4TraceEvent);
+	DS4TraceEvent *events = (DS4TraceEvent *)IOMalloc(eventsSize);
+	if (events == NULL)
+		return;
+	
+	size_t count = fTrace->snapshot(events, kDS4TraceCapacity);
+	OSData *data = OSData::withCapacity((unsigned)(kDS4TraceExportHeaderLength + count * kDS4TraceExportEventLength));
+	
+	if (data != NULL) {
+		UInt8 bytes[kDS4TraceExportHeaderLength > kDS4TraceExportEventLength ? kDS4TraceExportHeaderLength : kDS4TraceExportEventLength];
+		
+		DS4TraceWriteExportHeader(bytes, (UInt16)getRegistryEntryID(), (UInt32)count);
+		data->appendBytes(bytes, kDS4TraceExportHeaderLength);
+		
+		for (size_t i = 0; i < count; i++) {
+			UInt64 begin, end;
+			absolutetime_to_nanoseconds(events[i].begin, &begin);
+			absolutetime_to_nanoseconds(events[i].begin + events[i].duration, &end);
+			events[i].begin = begin;
+			events[i].duration = (UInt32)(end - begin);
+			
+			DS4TraceWriteExportEvent(bytes, &events[i]);
+			data->appendBytes(bytes, kDS4TraceExportEventLength);
+		}
+		
+		setProperty(kDS4TraceKey, data);
+		data->release();
+	}
+	
+	IOFree(events, eventsSize);
+}
+
+// The recognizer only runs on the report path, so turning it off and back on
+// just has to drop whatever contact it was tracking.
+void SonyPlaystationDualShock4::setGesturesEnabled(bool enabled)
+{
+	if (enabled && !__atomic_load_n(&fGesturesEnabled, __ATOMIC_ACQUIRE))
+		fGestures.reset();
+	
+	__atomic_store_n(&fGesturesEnabled, enabled, __ATOMIC_RELEASE);
+	setProperty(kDS4TouchGesturesKey, enabled);
+}
+
+void SonyPlaystationDualShock4::setMotionGesturesEnabled(bool enabled)
+{
+	if (enabled && !__atomic_load_n(&fMotionEnabled, __ATOMIC_ACQUIRE))
+		fMotion.reset();
+	
+	__atomic_store_n(&fMotionEnabled, enabled, __ATOMIC_RELEASE);
+	setProperty(kDS4MotionGesturesKey, enabled);
+}
+
+// Without the pointer collection in the descriptor there is nowhere to send
+// pointer reports, so the mode can only be paused and resumed at runtime.
+void SonyPlaystationDualShock4::setTrackpadEnabled(bool enabled)
+{
+	if (!fPointerCollection) {
+		if (enabled)
+			IOLog("DS4 Trackpad mode must be set in the personality\n");
+		return;
+	}
+	
+	if (enabled && !__atomic_load_n(&fTrackpadEnabled, __ATOMIC_ACQUIRE))
+		fTrackpad.reset();
+	
+	__atomic_store_n(&fTrackpadEnabled, enabled, __ATOMIC_RELEASE);
+	setProperty(kDS4TrackpadKey, enabled);
+}
+
+// Sends a pointer report for the touch state just decoded, through the
+// preallocated report buffer. Idle reports are skipped.
+void SonyPlaystationDualShock4::dispatchPointer(void)
+{
+	DS4PointerReport pointer;
+	
+	if (!fTrackpad.process(&fState, &pointer))
+		return;
+	
+	DS4WritePointerReport(&pointer, (UInt8 *)fPointerReport->getBytesNoCopy());
+	super::handleReport(fPointerReport, kIOHIDReportTypeInput, 0);
+}
+
+// Accepts a preset name, or an array of [left, top, right, bottom] arrays in
+// touchpad units. Reports are only handled on the work loop, so building the
+// map there means no report is still reading the copy being rebuilt. Before
+// the HID stack is up nothing reads the map and there may be no work loop.
+bool SonyPlaystationDualShock4::setTouchZones(OSObject *zones, bool requireClick)
+{
+	IOWorkLoop *workLoop = getWorkLoop();
+	
+	if (workLoop == NULL)
+		return buildTouchZones(zones, requireClick);
+	return workLoop->runAction(touchZonesAction, this, zones, (void *)(uintptr_t)requireClick) == kIOReturnSuccess;
+}
+
+IOReturn SonyPlaystationDualShock4::touchZonesAction(OSObject *owner, void *zones, void *requireClick, void *, void *)
+{
+	SonyPlaystationDualShock4 *me = (SonyPlaystationDualShock4 *)owner;
+	
+	return me->buildTouchZones((OSObject *)zones, requireClick != NULL) ? kIOReturnSuccess : kIOReturnBadArgument;
+}
+
+// Builds into the copy the report path is not using and swaps it in, so a
+// rejected map leaves the active one as it was.
+bool SonyPlaystationDualShock4::buildTouchZones(OSObject *zones, bool requireClick)
+{
+	UInt8 next = fZonesActive ^ 1;
+	bool configured = false;
+	
+	if (zones == NULL) {
+		configured = fZones[next].configure(kDS4TouchZonesNone, requireClick);
+	} else if (OSString *name = OSDynamicCast(OSString, zones)) {
+		for (int i = 0; i < kDS4TouchZonePresetCount; i++) {
+			if (name->isEqualTo(DS4TouchZonePresetNames[i])) {
+				configured = fZones[next].configure((DS4TouchZonePreset)i, requireClick);
+				break;
+			}
+		}
+	} else if (OSArray *list = OSDynamicCast(OSArray, zones)) {
+		DS4TouchZone rects[kDS4MaxTouchZones];
+		unsigned count = list->getCount();
+		
+		configured = count <= kDS4MaxTouchZones;
+		for (unsigned i = 0; configured && i < count; i++) {
+			OSArray *rect = OSDynamicCast(OSArray, list->getObject(i));
+			UInt16 edges[4];
+			
+			configured = rect != NULL && rect->getCount() == 4;
+			for (unsigned e = 0; configured && e < 4; e++) {
+				OSNumber *edge = OSDynamicCast(OSNumber, rect->getObject(e));
+				configured = edge != NULL;
+				if (configured)
+					edges[e] = edge->unsigned16BitValue();
+			}
+			if (configured)
+				rects[i] = (DS4TouchZone){ edges[0], edges[1], edges[2], edges[3] };
+		}
+		
+		if (configured)
+			configured = fZones[next].configure(rects, count, requireClick);
+	}
+	
+	if (configured) {
+		__atomic_store_n(&fZonesActive, next, __ATOMIC_RELEASE);
+		if (zones != NULL)
+			setProperty(kDS4TouchZonesKey, zones);
+		setProperty(kDS4TouchZonesClickKey, requireClick);
+	}
+	
+	if (!configured)
+		IOLog("DS4 Invalid touch zones\n");
+	return configured;
+}
+
+
+// Like the trace buffer, the histograms are allocated on first use and kept
+// until the device is freed. Turning collection off and on again carries on
+// counting into the same histograms.
+void SonyPlaystationDualShock4::setWearEnabled(bool enabled)
+{
+	if (enabled && fWear == NULL) {
+		DS4WearHistograms *wear = (DS4WearHistograms *)IOMalloc(sizeof(DS4WearHistograms));
+		if (wear == NULL)
+			return;
+		
+		wear->reset();
+		fWear = wear;
+	}
+	
+	__atomic_store_n(&fWearEnabled, enabled, __ATOMIC_RELEASE);
+	setProperty(kDS4WearEnabledKey, enabled);
+}
+
+// The history lives in its own pageable buffer so clients can map it. Like
+// the histograms it is allocated on first use and kept until the device is
+// freed; turning it off only stops recording, and turning it on again
+// carries on from the newest entry.
+void SonyPlaystationDualShock4::setHistoryEnabled(bool enabled)
+{
+	if (enabled && fHistory == NULL) {
+		IOBufferMemoryDescriptor *memory = IOBufferMemoryDescriptor::inTaskWithOptions(
+			kernel_task, kIODirectionInOut | kIOMemoryKernelUserShared, sizeof(DS4InputHistory), page_size);
+		if (memory == NULL)
+			return;
+		
+		DS4InputHistory *history = (DS4InputHistory *)memory->getBytesNoCopy();
+		history->reset();
+		fHistoryMemory = memory;
+		__atomic_store_n(&fHistory, history, __ATOMIC_RELEASE);
+	}
+	
+	__atomic_store_n(&fHistoryEnabled, enabled, __ATOMIC_RELEASE);
+	setProperty(kDS4InputHistoryKey, enabled);
+}
+
+IOMemoryDescriptor *SonyPlaystationDualShock4::copyHistoryMemory(void)
+{
+	if (__atomic_load_n(&fHistory, __ATOMIC_ACQUIRE) == NULL)
+		return NULL;
+	
+	fHistoryMemory->retain();
+	return fHistoryMemory;
+}
+
+IOReturn SonyPlaystationDualShock4::newUserClient(task_t owningTask, void *securityID, UInt32 type,
+												  OSDictionary *properties, IOUserClient **handler)
+{
+	if (type != kDS4HistoryClientType)
+		return super::newUserClient(owningTask, securityID, type, properties, handler);
+	
+	if (IOUserClient::clientHasPrivilege(owningTask, kIOClientPrivilegeAdministrator) != kIOReturnSuccess)
+		return kIOReturnNotPrivileged;
+	
+	DS4HistoryClient *client = OSTypeAlloc(DS4HistoryClient);
+	if (client == NULL)
+		return kIOReturnNoMemory;
+	
+	if (!client->initWithTask(owningTask, securityID, type, properties) || !client->attach(this)) {
+		client->release();
+		return kIOReturnBadArgument;
+	}
+	
+	if (!client->start(this)) {
+		client->detach(this);
+		client->release();
+		return kIOReturnError;
+	}
+	
+	*handler = client;
+	return kIOReturnSuccess;
+}
+
+// Counts are exported as little endian 32 bit values.
+static OSData *WearCounts(const DS4WearHistograms *wear, const uint32_t *counts, unsigned count)
+{
+	OSData *data = OSData::withCapacity(count * 4);
+	if (data == NULL)
+		return NULL;
+	
+	for (unsigned i = 0; i < count; i++) {
+		uint32_t value = wear->get(&counts[i]);
+		UInt8 bytes[4] = { (UInt8)value, (UInt8)(value >> 8), (UInt8)(value >> 16), (UInt8)(value >> 24) };
+		data->appendBytes(bytes, sizeof(bytes));
+	}
+	
+	return data;
+}
+
+static void SetOwnedObject(OSDictionary *dict, const char *key, OSObject *object)
+{
+	if (object != NULL) {
+		dict->setObject(key, object);
+		object->release();
+	}
+}
+
+// Publishes the histograms as the DS4Wear property, along with each stick's
+// rest offset and whether it is past kDS4WearDriftLimit.
+void SonyPlaystationDualShock4::publishWear(void)
+{
+	if (fWear == NULL)
+		return;
+	
+	OSDictionary *snapshot = OSDictionary::withCapacity(8);
+	OSDictionary *presses = OSDictionary::withCapacity(kDS4WearKeyCount);
+	if (snapshot == NULL || presses == NULL) {
+		OSSafeReleaseNULL(snapshot);
+		OSSafeReleaseNULL(presses);
+		return;
+	}
+	
+	SetOwnedObject(snapshot, "Samples", OSNumber::withNumber(__atomic_load_n(&fWear->samples, __ATOMIC_RELAXED), 64));
+	SetOwnedObject(snapshot, "L2", WearCounts(fWear, fWear->triggers[0], kDS4WearTriggerBins));
+	SetOwnedObject(snapshot, "R2", WearCounts(fWear, fWear->triggers[1], kDS4WearTriggerBins));
+	
+	static const char *const sticks[kDS4WearStickCount][3] = {
+		{ "LeftStick", "LeftRestOffset", "LeftDrift" },
+		{ "RightStick", "RightRestOffset", "RightDrift" }
+	};
+	for (int stick = 0; stick < kDS4WearStickCount; stick++) {
+		int dx, dy;
+		
+		fWear->restOffset((DS4WearStick)stick, &dx, &dy);
+		SetOwnedObject(snapshot, sticks[stick][0], WearCounts(fWear, fWear->sticks[stick], kDS4WearStickBins * kDS4WearStickBins));
+		
+		OSArray *offset = OSArray::withCapacity(2);
+		if (offset != NULL) {
+			int axes[2] = { dx, dy };
+			for (int i = 0; i < 2; i++) {
+				OSNumber *value = OSNumber::withNumber((unsigned long long)(SInt64)axes[i], 32);
+				if (value != NULL) {
+					offset->setObject(value);
+					value->release();
+				}
+			}
+			SetOwnedObject(snapshot, sticks[stick][1], offset);
+		}
+		
+		bool drift = dx > kDS4WearDriftLimit || dx < -kDS4WearDriftLimit || dy > kDS4WearDriftLimit || dy < -kDS4WearDriftLimit;
+		snapshot->setObject(sticks[stick][2], drift ? kOSBooleanTrue : kOSBooleanFalse);
+		if (drift)
+			IOLog("DS4 %s rests at %d, %d\n", sticks[stick][0], dx, dy);
+	}
+	
+	for (int key = 0; key < kDS4WearKeyCount; key++)
+		SetOwnedObject(presses, DS4WearKeyNames[key], WearCounts(fWear, fWear->presses[key], kDS4WearDurationBins));
+	SetOwnedObject(snapshot, "PressDurations", presses);
+	
+	setProperty(kDS4WearKey, snapshot);
+	snapshot->release();
+}
+
+// The setters only update the shadow; flushOutput() sends whatever they
+// changed as a single report, so several fields can be set for one write.
+void SonyPlaystationDualShock4::setRumble(UInt8 strong, UInt8 weak)
+{
+	IOLockLock(fOutputLock);
+	fOutput.setRumble(strong, weak);
+	IOLockUnlock(fOutputLock);
+}
+
+void SonyPlaystationDualShock4::setLightBar(UInt8 red, UInt8 green, UInt8 blue)
+{
+	IOLockLock(fOutputLock);
+	fOutput.setLight(red, green, blue);
+	IOLockUnlock(fOutputLock);
+}
+
+void SonyPlaystationDualShock4::setLightBarFlash(UInt8 on, UInt8 off)
+{
+	IOLockLock(fOutputLock);
+	fOutput.setFlash(on, off);
+	IOLockUnlock(fOutputLock);
+}
+
+IOReturn SonyPlaystationDualShock4::flushOutput(void)
+{
+	IOLockLock(fOutputLock);
+	IOReturn result = writeOutput();
+	IOLockUnlock(fOutputLock);
+	
+	return result;
+}
+
+// Sends the shadow if anything in it changed. Called with fOutputLock held,
+// which keeps writes in order. A failed write marks every field dirty, since
+// the pad's state is then unknown.
+IOReturn SonyPlaystationDualShock4::writeOutput(void)
+{
+	if (fInterface == NULL)
+		return kIOReturnNotOpen;
+	
+	size_t length;
+	const UInt8 *report = fOutput.build(&length);
+	if (report == NULL)
+		return kIOReturnSuccess;
+	
+	bool tracing = __atomic_load_n(&fTraceEnabled, __ATOMIC_ACQUIRE);
+	UInt64 submitted = 0, completed = 0;
+	if (tracing || fFlight != NULL)
+		clock_get_uptime(&submitted);
+	if (fFlight != NULL)
+		fFlight->record(kDS4CaptureOutput, report, length, submitted);
+	
+	IOReturn result = setControlReport(kDS4ReportKindOutput, report[0], report, (UInt16)length);
+	if (result == kIOReturnSuccess) {
+		fCounters.add(kDS4CounterOutputsWritten);
+	} else {
+		IOLog("DS4 Output report failed: 0x%08x\n", result);
+		fOutput.invalidate();
+	}
+	
+	if (tracing) {
+		UInt16 sequence = __atomic_load_n(&fReportSequence, __ATOMIC_RELAXED);
+		clock_get_uptime(&completed);
+		fTrace->record(kDS4TraceOutputSubmit, submitted, submitted, sequence);
+		fTrace->record(kDS4TraceOutputComplete, submitted, completed, sequence);
+	}
+	
+	return result;
+}
+
+// Keeps kDS4ReadsInFlight reads queued on the interrupt pipe. Completions
+// only queue the report and ask for a wakeup when a batch starts; the work
+// loop then delivers everything queued by then in one pass. With a
+// coalescing window the wakeup is a timer that long after the first report,
+// otherwise an interrupt event source that runs as soon as the work loop can.
+bool SonyPlaystationDualShock4::startReading(void)
+{
+	if (fInterface == NULL)
+		return true;
+	
+	IOUSBFindEndpointRequest request;
+	request.type = kUSBInterrupt;
+	request.direction = kUSBIn;
+	request.maxPacketSize = 0;
+	request.interval = 0;
+	
+	fInterruptPipe = fInterface->FindNextPipe(NULL, &request);
+	if (fInterruptPipe == NULL) {
+		IOLog("DS4 Could not find interrupt pipe\n");
+		return false;
+	}
+	fInterruptPipe->retain();
+	
+	IOWorkLoop *workLoop = getWorkLoop();
+	fReportSource = IOInterruptEventSource::interruptEventSource(this, reportsReady);
+	fCoalesceTimer = IOTimerEventSource::timerEventSource(this, coalesceTimeout);
+	fReadRetryTimer = IOTimerEventSource::timerEventSource(this, readRetryTimeout);
+	if (workLoop == NULL || fReportSource == NULL || fCoalesceTimer == NULL || fReadRetryTimer == NULL ||
+		workLoop->addEventSource(fReportSource) != kIOReturnSuccess ||
+		workLoop->addEventSource(fCoalesceTimer) != kIOReturnSuccess ||
+		workLoop->addEventSource(fReadRetryTimer) != kIOReturnSuccess) {
+		IOLog("DS4 Could not set up report delivery\n");
+		stopReading();
+		return false;
+	}
+	
+	fReportQueue.reset();
+	fReadErrors = 0;
+	fReadRetryPending = 0;
+	__atomic_store_n(&fReading, true, __ATOMIC_RELEASE);
+	for (int i = 0; i < kDS4ReadsInFlight; i++) {
+		if (!issueRead())
+			break;
+	}
+	
+	if (__atomic_load_n(&fReadsInFlight, __ATOMIC_RELAXED) == 0) {
+		IOLog("DS4 Could not start reading reports\n");
+		stopReading();
+		return false;
+	}
+	
+	return true;
+}
+
+// Aborting the pipe completes every outstanding read, which hands its buffer
+// back since fReading is already clear.
+void SonyPlaystationDualShock4::stopReading(void)
+{
+	__atomic_store_n(&fReading, false, __ATOMIC_RELEASE);
+	
+	if (fInterruptPipe != NULL) {
+		fInterruptPipe->Abort();
+		OSSafeReleaseNULL(fInterruptPipe);
+	}
+	
+	IOWorkLoop *workLoop = getWorkLoop();
+	if (fCoalesceTimer != NULL) {
+		fCoalesceTimer->cancelTimeout();
+		if (workLoop != NULL)
+			workLoop->removeEventSource(fCoalesceTimer);
+		OSSafeReleaseNULL(fCoalesceTimer);
+	}
+	if (fReadRetryTimer != NULL) {
+		fReadRetryTimer->cancelTimeout();
+		if (workLoop != NULL)
+			workLoop->removeEventSource(fReadRetryTimer);
+		OSSafeReleaseNULL(fReadRetryTimer);
+	}
+	if (fReportSource != NULL) {
+		if (workLoop != NULL)
+			workLoop->removeEventSource(fReportSource);
+		OSSafeReleaseNULL(fReportSource);
+	}
+	
+	DS4QueuedReport queued;
+	while (fReportQueue.pop(&queued))
+		fReportPool.release(queued.buffer);
+}
+
+bool SonyPlaystationDualShock4::issueRead(void)
+{
+	SInt32 buffer = fReportPool.acquire();
+	if (buffer < 0)
+		return false;
+	
+	// The USB family copies the completion, so one on the stack will do.
+	IOUSBCompletion completion;
+	completion.target = this;
+	completion.action = readComplete;
+	completion.parameter = (void *)(uintptr_t)buffer;
+	
+	__atomic_fetch_add(&fReadsInFlight, 1, __ATOMIC_RELAXED);
+	IOReturn result = fInterruptPipe->Read(fReportPool.descriptor(buffer), 0, 0,
+										   DS4TransportTraits<kDS4TransportUSB>::kReportLength, &completion);
+	if (result != kIOReturnSuccess) {
+		__atomic_fetch_sub(&fReadsInFlight, 1, __ATOMIC_RELAXED);
+		fReportPool.release(buffer);
+		return false;
+	}
+	
+	return true;
+}
+
+void SonyPlaystationDualShock4::readComplete(void *target, void *parameter, IOReturn status, UInt32 bufferSizeRemaining)
+{
+	SonyPlaystationDualShock4 *me = (SonyPlaystationDualShock4 *)target;
+	SInt32 buffer = (SInt32)(uintptr_t)parameter;
+	
+	__atomic_fetch_sub(&me->fReadsInFlight, 1, __ATOMIC_RELAXED);
+	if (!__atomic_load_n(&me->fReading, __ATOMIC_ACQUIRE)) {
+		me->fReportPool.release(buffer);
+		return;
+	}
+	
+	bool queued = false, wake = false;
+	if (status == kIOReturnSuccess) {
+		__atomic_store_n(&me->fReadErrors, 0, __ATOMIC_RELAXED);
+		
+		UInt64 now;
+		clock_get_uptime(&now);
+		
+		UInt32 length = DS4TransportTraits<kDS4TransportUSB>::kReportLength - bufferSizeRemaining;
+		queued = me->fReportQueue.push((UInt8)buffer, (UInt16)length, now, &wake);
+		if (!queued)
+			me->fCounters.add(kDS4CounterReportsDropped);
+	}
+	if (!queued)
+		me->fReportPool.release(buffer);
+	
+	// The pad is gone or the pipe is shutting down; reading again would only fail.
+	if (status == kIOReturnAborted || status == kIOReturnNotResponding)
+		return;
+	
+	// Anything else, a stall most likely, would fail again straight away.
+	// The reads still in flight fail the same way, so only the first one
+	// schedules the retry.
+	if (status != kIOReturnSuccess) {
+		me->fCounters.add(kDS4CounterReadErrors);
+		if (__atomic_exchange_n(&me->fReadRetryPending, 1, __ATOMIC_ACQ_REL) != 0)
+			return;
+		
+		UInt32 errors = __atomic_add_fetch(&me->fReadErrors, 1, __ATOMIC_RELAXED);
+		if (errors > kDS4ReadRetries) {
+			IOLog("DS4 Giving up on interrupt reads: 0x%08x\n", status);
+			return;
+		}
+		me->fReadRetryTimer->setTimeoutMS(kDS4ReadRetryMS << (errors - 1));
+		return;
+	}
+	
+	if (wake) {
+		UInt32 window = __atomic_load_n(&me->fCoalesceUS, __ATOMIC_RELAXED);
+		if (window != 0)
+			me->fCoalesceTimer->setTimeoutUS(window);
+		else
+			me->fReportSource->interruptOccurred(NULL, me, 0);
+	}
+	
+	me->issueRead();
+}
+
+void SonyPlaystationDualShock4::reportsReady(OSObject *owner, IOInterruptEventSource *source, int count)
+{
+	((SonyPlaystationDualShock4 *)owner)->drainReports();
+}
+
+void SonyPlaystationDualShock4::coalesceTimeout(OSObject *owner, IOTimerEventSource *timer)
+{
+	((SonyPlaystationDualShock4 *)owner)->drainReports();
+}
+
+// Runs from the coalesce timer when a window is set, so one pass on the work
+// loop handles every report that arrived during it.
+void SonyPlaystationDualShock4::drainReports(void)
+{
+	DS4QueuedReport queued;
+	UInt32 delivered = 0;
+	
+	fReportQueue.beginDrain();
+	while (fReportQueue.pop(&queued)) {
+		if (queued.length < DS4TransportTraits<kDS4TransportUSB>::kReportLength) {
+			fCounters.add(kDS4CounterReportsReceived);
+			fCounters.add(kDS4CounterReportsDropped);
+		} else {
+			if (delivered++ != 0)
+				fCounters.add(kDS4CounterReportsCoalesced);
+			handleInputReport(fReportPool.descriptor(queued.buffer), queued.arrival, 0);
+		}
+		fReportPool.release(queued.buffer);
+	}
+	
+	fillReads();
+}
+
+// Tops the reads in flight back up, unless a failed read is waiting out its
+// backoff.
+void SonyPlaystationDualShock4::fillReads(void)
+{
+	while (__atomic_load_n(&fReading, __ATOMIC_ACQUIRE) &&
+		   __atomic_load_n(&fReadRetryPending, __ATOMIC_ACQUIRE) == 0 &&
+		   __atomic_load_n(&fReadsInFlight, __ATOMIC_RELAXED) < kDS4ReadsInFlight) {
+		if (!issueRead())
+			break;
+	}
+}
+
+// Runs on the work loop, where the synchronous clear is allowed.
+void SonyPlaystationDualShock4::readRetryTimeout(OSObject *owner, IOTimerEventSource *timer)
+{
+	SonyPlaystationDualShock4 *me = (SonyPlaystationDualShock4 *)owner;
+	
+	if (!__atomic_load_n(&me->fReading, __ATOMIC_ACQUIRE))
+		return;
+	
+	IOReturn result = me->fInterruptPipe->ClearPipeStall(true);
+	if (result != kIOReturnSuccess)
+		IOLog("DS4 Could not clear interrupt pipe: 0x%08x\n", result);
+	
+	__atomic_store_n(&me->fReadRetryPending, 0, __ATOMIC_RELEASE);
+	me->fillReads();
+}
+
+void SonyPlaystationDualShock4::setCoalesceWindow(UInt32 microseconds)
+{
+	if (microseconds > kDS4MaxCoalesceUS)
+		microseconds = kDS4MaxCoalesceUS;
+	
+	__atomic_store_n(&fCoalesceUS, microseconds, __ATOMIC_RELAXED);
+	setProperty(kDS4CoalesceWindowKey, microseconds, 32);
+}
+
+// The recorder is on unless the personality turns it off. Its triggers are
+// fixed at start: the chord from DS4FlightChord (a DS4 button mask, 0 for
+// none), the gap from the variant's report rate.
+void SonyPlaystationDualShock4::startFlightRecorder(void)
+{
+	OSBoolean *enabled = OSDynamicCast(OSBoolean, getProperty(kDS4FlightRecorderKey));
+	if (enabled != NULL && !enabled->isTrue())
+		return;
+	
+	fFlightCall = thread_call_allocate(flightDumpCall, this);
+	fFlight = (DS4FlightRecorder *)IOMalloc(sizeof(DS4FlightRecorder));
+	if (fFlightCall == NULL || fFlight == NULL) {
+		IOLog("DS4 Could not allocate flight recorder\n");
+		if (fFlight != NULL)
+			IOFree(fFlight, sizeof(DS4FlightRecorder));
+		fFlight = NULL;
+		return;
+	}
+	
+	OSNumber *chord = OSDynamicCast(OSNumber, getProperty(kDS4FlightChordKey));
+	UInt64 gap;
+	nanoseconds_to_absolutetime(kDS4FlightGapPeriods * (1000000000ULL / fVariant->reportRateHz), &gap);
+	
+	fFlight->reset(chord != NULL ? chord->unsigned32BitValue() : kDS4FlightDefaultChord, gap, kDS4FlightMaxLoss);
+	setProperty(kDS4FlightRecorderKey, true);
+}
+
+// Only flags the dump and hands it to a thread call, so the report path never
+// waits on it. While a dump is pending further triggers are dropped, and
+// automatic ones also within kDS4FlightHoldoffMS of the last.
+void SonyPlaystationDualShock4::triggerFlightDump(DS4FlightTrigger trigger, UInt64 now)
+{
+	if (trigger != kDS4FlightTriggerRequest) {
+		UInt64 holdoff;
+		nanoseconds_to_absolutetime(kDS4FlightHoldoffMS * 1000000ULL, &holdoff);
+		if (fFlightLastAutomatic != 0 && now - fFlightLastAutomatic < holdoff)
+			return;
+		fFlightLastAutomatic = now;
+	}
+	
+	UInt32 idle = kDS4FlightTriggerNone;
+	if (!__atomic_compare_exchange_n(&fFlightPending, &idle, (UInt32)trigger, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		return;
+	
+	retain();
+	if (thread_call_enter(fFlightCall))
+		release();
+}
+
+void SonyPlaystationDualShock4::flightDumpCall(thread_call_param_t owner, thread_call_param_t unused)
+{
+	SonyPlaystationDualShock4 *me = (SonyPlaystationDualShock4 *)owner;
+	
+	me->dumpFlight();
+	me->release();
+}
+
+static uint64_t FlightNanoseconds(uint64_t time)
+{
+	UInt64 ns;
+	absolutetime_to_nanoseconds(time, &ns);
+	return ns;
+}
+
+// Publishes the last kDS4FlightSeconds of reports as a capture file in the
+// DS4FlightRecording property, with the reason in DS4FlightTrigger.
+void SonyPlaystationDualShock4::dumpFlight(void)
+{
+	DS4FlightTrigger trigger = (DS4FlightTrigger)__atomic_load_n(&fFlightPending, __ATOMIC_ACQUIRE);
+	UInt8 *capture = (UInt8 *)IOMalloc(kDS4FlightDumpCapacity);
+	
+	if (capture != NULL) {
+		UInt64 now, window;
+		clock_get_uptime(&now);
+		nanoseconds_to_absolutetime(kDS4FlightSeconds * 1000000000ULL, &window);
+		
+		size_t length = fFlight->dump(capture, (UInt8)kDS4TransportUSB, fVariant->variant,
+									  now > window ? now - window : 0, FlightNanoseconds);
+		OSData *data = OSData::withBytes(capture, (unsigned)length);
+		if (data != NULL) {
+			setProperty(kDS4FlightRecordingKey, data);
+			setProperty(kDS4FlightTriggerKey, DS4FlightTriggerNames[trigger]);
+			data->release();
+			IOLog("DS4 Flight recording saved (%s, %u bytes)\n", DS4FlightTriggerNames[trigger], (unsigned)length);
+		}
+		IOFree(capture, kDS4FlightDumpCapacity);
+	}
+	
+	__atomic_store_n(&fFlightPending, kDS4FlightTriggerNone, __ATOMIC_RELEASE);
+}
+
+// Pairs the pad with the host described by request: HostAddress, 6 bytes
+// most significant first as DS4PairedHostAddress shows it, and LinkKey, 16
+// bytes. The transfers go out asynchronously on the control pipe, so
+// DS4Service can start every attached pad at once and each only waits on its
+// own transfers. Progress is published in DS4PairingStatus.
+IOReturn SonyPlaystationDualShock4::startPairing(OSDictionary *request)
+{
+	OSData *host = OSDynamicCast(OSData, request->getObject(kDS4PairHostAddressKey));
+	OSData *key = OSDynamicCast(OSData, request->getObject(kDS4PairLinkKeyKey));
+	if (host == NULL || host->getLength() != 6 || key == NULL || key->getLength() != kDS4LinkKeyLength)
+		return kIOReturnBadArgument;
+	
+	if (fInterface == NULL)
+		return kIOReturnNotOpen;
+	
+	UInt32 idle = 0;
+	if (!__atomic_compare_exchange_n(&fPairingBusy, &idle, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return kIOReturnBusy;
+	
+	UInt8 hostMAC[6];
+	const UInt8 *address = (const UInt8 *)host->getBytesNoCopy();
+	for (int i = 0; i < 6; i++)
+		hostMAC[i] = address[5 - i];
+	
+	// The pad's identity was read at attach, so the pairing starts with the write.
+	UInt64 now;
+	clock_get_uptime(&now);
+	fPairing.reset(hostMAC, (const UInt8 *)key->getBytesNoCopy(), kDS4PairingRetries);
+	fPairing.begin(&fPairPad, now, (fIdentity.flags & kDS4IdentityHasMAC) ? &fIdentity : NULL);
+	
+	retain();
+	issuePairing();
+	return kIOReturnSuccess;
+}
+
+// Sends the pad's next pairing transfer. One that cannot even be submitted
+// counts as a failed attempt, so this loops until a transfer is in flight or
+// the pad is done; then it records the outcome and drops the reference
+// startPairing took.
+void SonyPlaystationDualShock4::issuePairing(void)
+{
+	DS4PairingRequest step;
+	
+	publishPairing();
+	while (fPairing.next(&fPairPad, &step)) {
+		// The USB family copies the completion; the request itself has to
+		// stay put until the transfer completes.
+		IOUSBCompletion completion;
+		completion.target = this;
+		completion.action = pairingComplete;
+		completion.parameter = NULL;
+		
+		UInt8 direction = (step.direction == kDS4PairingGetReport) ? kUSBIn : kUSBOut;
+		IOReturn result = makeControlRequest(direction, kDS4ReportKindFeature, step.reportID,
+											 step.buffer, step.length, &fPairRequest);
+		if (result == kIOReturnSuccess)
+			result = fDevice->DeviceRequest(&fPairRequest, kDS4ControlTimeoutMS, kDS4ControlTimeoutMS, &completion);
+		if (result == kIOReturnSuccess)
+			return;
+		
+		UInt64 now;
+		clock_get_uptime(&now);
+		fPairing.complete(&fPairPad, result, 0, now);
+	}
+	
+	if (fPairPad.step == kDS4PairingPaired) {
+		memcpy(fIdentity.hostMAC, fPairPad.identity.hostMAC, sizeof(fIdentity.hostMAC));
+		fIdentity.flags |= kDS4IdentityHasHostMAC;
+		if (fService != NULL)
+			fService->storeIdentity(&fIdentity);
+		publishIdentity();
+	} else {
+		IOLog("DS4 Pairing failed while %s: 0x%08x\n",
+			  DS4PairingStepNames[fPairPad.failedStep], fPairPad.error);
+	}
+	
+	publishPairing();
+	__atomic_store_n(&fPairingBusy, 0, __ATOMIC_RELEASE);
+	release();
+}
+
+void SonyPlaystationDualShock4::pairingComplete(void *target, void *parameter, IOReturn status, UInt32 bufferSizeRemaining)
+{
+	SonyPlaystationDualShock4 *me = (SonyPlaystationDualShock4 *)target;
+	UInt64 now;
+	
+	clock_get_uptime(&now);
+	me->fPairing.complete(&me->fPairPad, status, me->fPairRequest.wLength - bufferSizeRemaining, now);
+	me->issuePairing();
+}
+
+void SonyPlaystationDualShock4::publishPairing(void)
+{
+	OSDictionary *status = OSDictionary::withCapacity(4);
+	if (status == NULL)
+		return;
+	
+	SetOwnedObject(status, "Step", OSString::withCString(DS4PairingStepNames[fPairPad.step]));
+	SetOwnedObject(status, "Attempts", OSNumber::withNumber(fPairPad.attempts, 8));
+	
+	if (fPairPad.step == kDS4PairingFailed) {
+		SetOwnedObject(status, "FailedStep", OSString::withCString(DS4PairingStepNames[fPairPad.failedStep]));
+		SetOwnedObject(status, "Error", OSNumber::withNumber((UInt32)fPairPad.error, 32));
+	}
+	if (DS4PairingStation::done(&fPairPad)) {
+		UInt64 ns;
+		absolutetime_to_nanoseconds(fPairPad.finished - fPairPad.started, &ns);
+		SetOwnedObject(status, "Milliseconds", OSNumber::withNumber(ns / 1000000, 32));
+	}
+	
+	setProperty(kDS4PairingStatusKey, status);
+	status->release();
+}
+
+IOReturn SonyPlaystationDualShock4::runFeatures(DS4FeatureOp *ops, UInt32 count, FeatureAction action, void *context)
+{
+	if (count == 0 || count > kDS4FeatureBatchMax || action == NULL)
+		return kIOReturnBadArgument;
+	if (fInterface == NULL)
+		return kIOReturnNotOpen;
+	
+	UInt32 idle = 0;
+	if (!__atomic_compare_exchange_n(&fBatchBusy, &idle, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return kIOReturnBusy;
+	
+	fBatch.reset(ops, count, kDS4FeaturesInFlight);
+	if (fBatch.validate(&fReportSizes) >= 0) {
+		__atomic_store_n(&fBatchBusy, 0, __ATOMIC_RELEASE);
+		return kIOReturnBadArgument;
+	}
+	
+	fBatchAction = action;
+	fBatchContext = context;
+	
+	retain();
+	pumpFeatures();
+	return kIOReturnSuccess;
+}
+
+// Submits operations until kDS4FeaturesInFlight are queued or none are left.
+// Called by the submitter and again from each completion, so the pipe never
+// waits on a round trip through the caller for its next transfer.
+void SonyPlaystationDualShock4::pumpFeatures(void)
+{
+	int index;
+	
+	while ((index = fBatch.claim()) >= 0) {
+		DS4FeatureOp *op = &fBatch.ops[index];
+		
+		// The USB family copies the completion; the request stays in
+		// fBatchRequests until the transfer completes.
+		IOUSBCompletion completion;
+		completion.target = this;
+		completion.action = featureComplete;
+		completion.parameter = (void *)(intptr_t)index;
+		
+		UInt8 direction = (op->direction == kDS4FeatureGet) ? kUSBIn : kUSBOut;
+		IOReturn result = makeControlRequest(direction, kDS4ReportKindFeature, op->reportID,
+											 op->buffer, op->length, &fBatchRequests[index]);
+		if (result == kIOReturnSuccess)
+			result = fDevice->DeviceRequest(&fBatchRequests[index], kDS4ControlTimeoutMS, kDS4ControlTimeoutMS, &completion);
+		if (result != kIOReturnSuccess && finishFeature(index, result, 0))
+			return;
+	}
+}
+
+// Records one operation. The last one calls the batch's action and drops
+// the reference runFeatures took; returns true then.
+bool SonyPlaystationDualShock4::finishFeature(int index, IOReturn status, UInt32 transferred)
+{
+	if (status == kIOReturnSuccess && fBatch.ops[index].direction == kDS4FeatureGet &&
+		transferred < fBatchRequests[index].wLength)
+		status = kIOReturnUnderrun;
+	
+	if (!fBatch.complete(index, status, (UInt16)transferred))
+		return false;
+	
+	FeatureAction action = fBatchAction;
+	void *context = fBatchContext;
+	IOReturn result = fBatch.result();
+	
+	__atomic_store_n(&fBatchBusy, 0, __ATOMIC_RELEASE);
+	action(this, context, result);
+	release();
+	return true;
+}
+
+void SonyPlaystationDualShock4::featureComplete(void *target, void *parameter, IOReturn status, UInt32 bufferSizeRemaining)
+{
+	SonyPlaystationDualShock4 *me = (SonyPlaystationDualShock4 *)target;
+	int index = (int)(intptr_t)parameter;
+	
+	if (!me->finishFeature(index, status, me->fBatchRequests[index].wLength - bufferSizeRemaining))
+		me->pumpFeatures();
+}
+
+struct DS4FeatureWait {
+	IOLock		*lock;
+	bool		done;
+	IOReturn	status;
+};
+
+void SonyPlaystationDualShock4::featuresDone(SonyPlaystationDualShock4 *owner, void *context, IOReturn status)
+{
+	DS4FeatureWait *wait = (DS4FeatureWait *)context;
+	
+	IOLockLock(wait->lock);
+	wait->status = status;
+	wait->done = true;
+	IOLockWakeup(wait->lock, wait, false);
+	IOLockUnlock(wait->lock);
+}
+
+// runFeatures for callers that can block, such as start.
+IOReturn SonyPlaystationDualShock4::runFeaturesSync(DS4FeatureOp *ops, UInt32 count)
+{
+	DS4FeatureWait wait;
+	wait.lock = fBatchLock;
+	wait.done = false;
+	wait.status = kIOReturnSuccess;
+	
+	IOReturn result = runFeatures(ops, count, featuresDone, &wait);
+	if (result != kIOReturnSuccess)
+		return result;
+	
+	IOLockLock(wait.lock);
+	while (!wait.done)
+		IOLockSleep(wait.lock, &wait, THREAD_UNINT);
+	IOLockUnlock(wait.lock);
+	
+	return wait.status;
+}
+
+// Sets up the frame timer and the report it delivers, then applies any
+// DS4FrameSync from the personality. Frame sync stays off when this fails.
+bool SonyPlaystationDualShock4::startFrameSync(void)
+{
+	UInt32 length = DS4TransportTraits<kDS4TransportUSB>::kReportLength;
+	IOWorkLoop *workLoop = getWorkLoop();
+	
+	if (fFrameLock == NULL)
+		fFrameLock = IOLockAlloc();
+	if (fResampler == NULL)
+		fResampler = (DS4FrameResampler *)IOMalloc(sizeof(DS4FrameResampler));
+	fFrameReport = IOBufferMemoryDescriptor::inTaskWithOptions(kernel_task, 0, length);
+	fFrameTimer = IOTimerEventSource::timerEventSource(this, frameTimeout);
+	
+	if (fFrameLock == NULL || fResampler == NULL || fFrameReport == NULL || fFrameTimer == NULL ||
+		workLoop == NULL || workLoop->addEventSource(fFrameTimer) != kIOReturnSuccess) {
+		IOLog("DS4 Could not set up frame sync\n");
+		OSSafeReleaseNULL(fFrameTimer);
+		OSSafeReleaseNULL(fFrameReport);
+		return false;
+	}
+	
+	fResampler->reset(kDS4TransportUSB, 0, 0, 0);
+	
+	OSObject *config = getProperty(kDS4FrameSyncKey);
+	if (config != NULL && setFrameSync(config) != kIOReturnSuccess)
+		IOLog("DS4 Ignoring bad %s\n", kDS4FrameSyncKey);
+	
+	return true;
+}
+
+void SonyPlaystationDualShock4::stopFrameSync(void)
+{
+	__atomic_store_n(&fFrameSync, false, __ATOMIC_RELEASE);
+	
+	if (fFrameTimer != NULL) {
+		fFrameTimer->cancelTimeout();
+		IOWorkLoop *workLoop = getWorkLoop();
+		if (workLoop != NULL)
+			workLoop->removeEventSource(fFrameTimer);
+		OSSafeReleaseNULL(fFrameTimer);
+	}
+	
+	OSSafeReleaseNULL(fFrameReport);
+}
+
+// A dictionary with PeriodNS, the client's frame period, and optionally
+// PhaseNS, the uptime in nanoseconds of any one of its frames, and DelayNS,
+// how far behind the frame time input is sampled, turns frame sync on.
+// false turns it off. There is one frame clock per pad, shared by every
+// client of its HID device.
+IOReturn SonyPlaystationDualShock4::setFrameSync(OSObject *config)
+{
+	if (fFrameTimer == NULL)
+		return kIOReturnNotReady;
+	
+	OSBoolean *enabled = OSDynamicCast(OSBoolean, config);
+	if (enabled != NULL && !enabled->isTrue()) {
+		__atomic_store_n(&fFrameSync, false, __ATOMIC_RELEASE);
+		fFrameTimer->cancelTimeout();
+		setProperty(kDS4FrameSyncKey, false);
+		return kIOReturnSuccess;
+	}
+	
+	OSDictionary *dict = OSDynamicCast(OSDictionary, config);
+	OSNumber *period = (dict != NULL) ? OSDynamicCast(OSNumber, dict->getObject(kDS4FramePeriodKey)) : NULL;
+	if (period == NULL || period->unsigned64BitValue() < kDS4FrameMinPeriodNS ||
+		period->unsigned64BitValue() > kDS4FrameMaxPeriodNS)
+		return kIOReturnBadArgument;
+	
+	OSNumber *phase = OSDynamicCast(OSNumber, dict->getObject(kDS4FramePhaseKey));
+	OSNumber *delay = OSDynamicCast(OSNumber, dict->getObject(kDS4FrameDelayKey));
+	UInt64 sampleDelay = (delay != NULL) ? delay->unsigned64BitValue()
+										 : kDS4FrameDelayHalves * (1000000000ULL / fVariant->reportRateHz) / 2;
+	
+	UInt64 now, next;
+	clock_get_uptime(&now);
+	absolutetime_to_nanoseconds(now, &now);
+	
+	IOLockLock(fFrameLock);
+	fResampler->reset(kDS4TransportUSB, period->unsigned64BitValue(), phase != NULL ? phase->unsigned64BitValue() : now, sampleDelay);
+	fFrameNext = next = fResampler->nextFrame(now);
+	IOLockUnlock(fFrameLock);
+	
+	__atomic_store_n(&fFrameSync, true, __ATOMIC_RELEASE);
+	nanoseconds_to_absolutetime(next, &next);
+	fFrameTimer->wakeAtTime(next);
+	
+	setProperty(kDS4FrameSyncKey, dict);
+	return kIOReturnSuccess;
+}
+
+void SonyPlaystationDualShock4::frameTimeout(OSObject *owner, IOTimerEventSource *timer)
+{
+	((SonyPlaystationDualShock4 *)owner)->deliverFrame();
+}
+
+// Runs on the work loop at each frame boundary. The frame is built for the
+// time it was due rather than when the timer got to it, so every frame sees
+// input at the same age; the next boundary is worked out from the phase, so
+// timer lateness never accumulates.
+void SonyPlaystationDualShock4::deliverFrame(void)
+{
+	if (!__atomic_load_n(&fFrameSync, __ATOMIC_ACQUIRE))
+		return;
+	
+	UInt8 *frame = (UInt8 *)fFrameReport->getBytesNoCopy();
+	UInt64 now, next;
+	clock_get_uptime(&now);
+	absolutetime_to_nanoseconds(now, &now);
+	
+	IOLockLock(fFrameLock);
+	bool built = fResampler->frame(fFrameNext, frame);
+	fFrameNext = next = fResampler->nextFrame(now);
+	IOLockUnlock(fFrameLock);
+	
+	nanoseconds_to_absolutetime(next, &next);
+	fFrameTimer->wakeAtTime(next);
+	
+	if (!built)
+		return;
+	
+	fCounters.add(kDS4CounterFramesResampled);
+	if (fModeBytes == NULL) {
+		super::handleReport(fFrameReport, kIOHIDReportTypeInput, 0);
+	} else {
+		fReportMode->translate(frame + fPayloadOffset, fModeBytes);
+		super::handleReport(fModeReport, kIOHIDReportTypeInput, 0);
+	}
+}
@@ -1,6 +1,66 @@
 #include <IOKit/usb/IOUSBDevice.h>
+#include <IOKit/usb/IOUSBInterface.h>
 #include <IOKit/hid/IOHIDDevice.h>
+#include <IOKit/IOWorkLoop.h>
+#include <IOKit/IOInterruptEventSource.h>
+#include <IOKit/IOTimerEventSource.h>
 
+#include "DS4Report.h"
+#include "DS4ReportDescriptor.h"
+#include "DS4ReportPool.h"
+#include "DS4ReportQueue.h"
+#include "DS4Trace.h"
+#include "DS4Counters.h"
+#include "DS4Identity.h"
+#include "DS4Service.h"
+#include "DS4TouchGestures.h"
+#include "DS4Trackpad.h"
+#include "DS4TouchZones.h"
+#include "DS4MotionGestures.h"
+#include "DS4ReportModes.h"
+#include "DS4Wear.h"
+#include "DS4Output.h"
+#include "DS4FlightRecorder.h"
+#include "DS4Pairing.h"
+#include "DS4FeatureBatch.h"
+#include "DS4Resampler.h"
+#include "DS4InputHistory.h"
+
+#define kDS4TraceEnabledKey		"DS4TraceEnabled"
+#define kDS4TraceSnapshotKey	"DS4TraceSnapshot"
+#define kDS4TraceKey			"DS4Trace"
+#define kDS4CountersKey			"DS4Counters"
+#define kDS4TouchGesturesKey	"DS4TouchGestures"
+#define kDS4TrackpadKey			"DS4Trackpad"
+#define kDS4TouchZonesKey		"DS4TouchZones"
+#define kDS4TouchZonesClickKey	"DS4TouchZonesRequireClick"
+#define kDS4MotionGesturesKey	"DS4MotionGestures"
+#define kDS4ReportModeKey		"DS4ReportMode"
+#define kDS4WearEnabledKey		"DS4WearEnabled"
+#define kDS4WearSnapshotKey		"DS4WearSnapshot"
+#define kDS4WearKey				"DS4Wear"
+#define kDS4RumbleKey			"DS4Rumble"
+#define kDS4LightBarKey			"DS4LightBar"
+#define kDS4LightBarFlashKey	"DS4LightBarFlash"
+#define kDS4CoalesceWindowKey	"DS4CoalesceWindowUS"
+#define kDS4FlightRecorderKey	"DS4FlightRecorder"
+#define kDS4FlightChordKey		"DS4FlightChord"
+#define kDS4FlightDumpKey		"DS4FlightDump"
+#define kDS4FlightRecordingKey	"DS4FlightRecording"
+#define kDS4FlightTriggerKey	"DS4FlightTrigger"
+#define kDS4PairKey				"DS4Pair"
+#define kDS4PairHostAddressKey	"HostAddress"
+#define kDS4PairLinkKeyKey		"LinkKey"
+#define kDS4PairingStatusKey	"DS4PairingStatus"
+#define kDS4FrameSyncKey		"DS4FrameSync"
+#define kDS4FramePeriodKey		"PeriodNS"
+#define kDS4FramePhaseKey		"PhaseNS"
+#define kDS4FrameDelayKey		"DelayNS"
+#define kDS4InputHistoryKey		"DS4InputHistory"
+
+// Drives pads attached over USB; every personality matches IOUSBDevice.
+// Pads on Bluetooth stay with the system's Bluetooth HID driver, so the
+// Bluetooth framing in DS4Report.h and DS4Output.h only serves the host tools.
 class SonyPlaystationDualShock4 : public IOHIDDevice
 {
 	OSDeclareDefaultStructors(SonyPlaystationDualShock4)
@@ -15,4 +75,151 @@ public:
 	
 	
 	virtual IOReturn newReportDescriptor(IOMemoryDescriptor **descriptor) const;
+	virtual IOReturn handleReport(IOMemoryDescriptor *report,
+								  IOHIDReportType reportType = kIOHIDReportTypeInput,
+								  IOOptionBits options = 0);
+	virtual IOReturn getReport(IOMemoryDescriptor *report, IOHIDReportType reportType, IOOptionBits options);
+	virtual IOReturn setReport(IOMemoryDescriptor *report, IOHIDReportType reportType, IOOptionBits options);
+	virtual IOReturn setProperties(OSObject *properties);
+	virtual bool serializeProperties(OSSerialize *serialize) const;
+	virtual IOReturn newUserClient(task_t owningTask, void *securityID, UInt32 type,
+								   OSDictionary *properties, IOUserClient **handler);
+	
+	void setRumble(UInt8 strong, UInt8 weak);
+	void setLightBar(UInt8 red, UInt8 green, UInt8 blue);
+	void setLightBarFlash(UInt8 on, UInt8 off);
+	IOReturn flushOutput(void);
+	IOReturn startPairing(OSDictionary *request);
+	
+	// Runs a batch of feature report transfers with a few in flight at once
+	// and calls action once when the last one finishes. ops has to stay put
+	// until then; each op's status says how it went.
+	typedef void (*FeatureAction)(SonyPlaystationDualShock4 *owner, void *context, IOReturn status);
+	IOReturn runFeatures(DS4FeatureOp *ops, UInt32 count, FeatureAction action, void *context);
+	IOReturn runFeaturesSync(DS4FeatureOp *ops, UInt32 count);
+	
+	// The input history as a retained descriptor for a client to map, or
+	// NULL while DS4InputHistory has never been turned on.
+	IOMemoryDescriptor *copyHistoryMemory(void);
+	
+private:
+	bool openInterface(IOService *provider);
+	void releaseResources(void);
+	IOReturn handleInputReport(IOMemoryDescriptor *report, UInt64 arrival, IOOptionBits options);
+	IOReturn makeControlRequest(UInt8 direction, DS4ReportKind kind, UInt8 reportID,
+								UInt8 *buffer, UInt16 length, IOUSBDevRequest *request);
+	IOReturn getFeatureReport(UInt8 reportID, UInt8 *buffer, UInt16 length);
+	IOReturn setControlReport(DS4ReportKind kind, UInt8 reportID, const UInt8 *buffer, UInt16 length);
+	IOReturn writeOutput(void);
+	void pumpFeatures(void);
+	bool finishFeature(int index, IOReturn status, UInt32 transferred);
+	static void featureComplete(void *target, void *parameter, IOReturn status, UInt32 bufferSizeRemaining);
+	static void featuresDone(SonyPlaystationDualShock4 *owner, void *context, IOReturn status);
+	
+	bool startReading(void);
+	void stopReading(void);
+	bool issueRead(void);
+	void drainReports(void);
+	void setCoalesceWindow(UInt32 microseconds);
+	static void readComplete(void *target, void *parameter, IOReturn status, UInt32 bufferSizeRemaining);
+	static void reportsReady(OSObject *owner, IOInterruptEventSource *source, int count);
+	static void coalesceTimeout(OSObject *owner, IOTimerEventSource *timer);
+	void fillReads(void);
+	static void readRetryTimeout(OSObject *owner, IOTimerEventSource *timer);
+	
+	bool startFrameSync(void);
+	void stopFrameSync(void);
+	IOReturn setFrameSync(OSObject *config);
+	void deliverFrame(void);
+	static void frameTimeout(OSObject *owner, IOTimerEventSource *timer);
+	
+	void startFlightRecorder(void);
+	void triggerFlightDump(DS4FlightTrigger trigger, UInt64 now);
+	void dumpFlight(void);
+	static void flightDumpCall(thread_call_param_t owner, thread_call_param_t unused);
+	void issuePairing(void);
+	void publishPairing(void);
+	static void pairingComplete(void *target, void *parameter, IOReturn status, UInt32 bufferSizeRemaining);
+	void readIdentity(void);
+	void publishIdentity(void);
+	
+	void publishCounters(void);
+	void setTraceEnabled(bool enabled);
+	void publishTrace(void);
+	void setGesturesEnabled(bool enabled);
+	void setMotionGesturesEnabled(bool enabled);
+	void setTrackpadEnabled(bool enabled);
+	void dispatchPointer(void);
+	bool setTouchZones(OSObject *zones, bool requireClick);
+	bool buildTouchZones(OSObject *zones, bool requireClick);
+	static IOReturn touchZonesAction(OSObject *owner, void *zones, void *requireClick, void *, void *);
+	void setWearEnabled(bool enabled);
+	void publishWear(void);
+	void setHistoryEnabled(bool enabled);
+	
+	const DS4VariantInfo *fVariant;
+	DS4DecodeFunction fDecode;
+	const DS4ReportModeInfo *fReportMode;
+	IOBufferMemoryDescriptor *fModeReport;
+	UInt8 *fModeBytes;
+	UInt32 fPayloadOffset;
+	DS4State fState;
+	DS4ReportSizes fReportSizes;
+	DS4ReportPool fReportPool;
+	DS4ReportQueue fReportQueue;
+	IOUSBPipe *fInterruptPipe;
+	IOInterruptEventSource *fReportSource;
+	IOTimerEventSource *fCoalesceTimer;
+	UInt32 fCoalesceUS;
+	UInt32 fReadsInFlight;
+	IOTimerEventSource *fReadRetryTimer;
+	UInt32 fReadErrors;
+	UInt32 fReadRetryPending;
+	bool fReading;
+	DS4FlightRecorder *fFlight;
+	thread_call_t fFlightCall;
+	UInt32 fFlightPending;
+	UInt64 fFlightLastAutomatic;
+	DS4PairingStation fPairing;
+	DS4PairingPad fPairPad;
+	IOUSBDevRequest fPairRequest;
+	UInt32 fPairingBusy;
+	DS4FeatureBatch fBatch;
+	IOUSBDevRequest fBatchRequests[kDS4FeatureBatchMax];
+	FeatureAction fBatchAction;
+	void *fBatchContext;
+	UInt32 fBatchBusy;
+	IOLock *fBatchLock;
+	DS4FrameResampler *fResampler;
+	IOTimerEventSource *fFrameTimer;
+	IOBufferMemoryDescriptor *fFrameReport;
+	IOLock *fFrameLock;
+	UInt64 fFrameNext;
+	bool fFrameSync;
+	IOUSBDevice *fDevice;
+	IOUSBInterface *fInterface;
+	DS4Service *fService;
+	DS4DeviceIdentity fIdentity;
+	UInt16 fReportSequence;
+	DS4TraceBuffer *fTrace;
+	bool fTraceEnabled;
+	DS4Counters fCounters;
+	UInt64 fCountersPublished;
+	DS4TouchGestures fGestures;
+	bool fGesturesEnabled;
+	DS4MotionGestures fMotion;
+	bool fMotionEnabled;
+	DS4Trackpad fTrackpad;
+	bool fTrackpadEnabled;
+	bool fPointerCollection;
+	IOBufferMemoryDescriptor *fPointerReport;
+	DS4TouchZones fZones[2];
+	UInt8 fZonesActive;
+	DS4WearHistograms *fWear;
+	bool fWearEnabled;
+	IOBufferMemoryDescriptor *fHistoryMemory;
+	DS4InputHistory *fHistory;
+	bool fHistoryEnabled;
+	DS4OutputShadow fOutput;
+	IOLock *fOutputLock;
 };
\ No newline at end of file
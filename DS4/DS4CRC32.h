@@ -0,0 +1,29 @@
+//
+//  DS4CRC32.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4CRC32_h
+#define DS4_DS4CRC32_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Bluetooth reports are protected by an IEEE 802.3 CRC32 computed over the
+// HID transaction header followed by the report itself.
+#define kDS4CRC32SeedInput	0xA1	//	DATA | Input
+#define kDS4CRC32SeedOutput	0xA2	//	DATA | Output
+#define kDS4CRC32SeedFeature	0xA3	//	DATA | Feature
+
+uint32_t DS4CRC32Update(uint32_t crc, const uint8_t *data, size_t length);
+
+// CRC of (seed, data[0 .. length)), as stored little endian in the report trailer.
+static inline uint32_t DS4CRC32(uint8_t seed, const uint8_t *data, size_t length)
+{
+	uint32_t crc = DS4CRC32Update(0xFFFFFFFF, &seed, 1);
+	return ~DS4CRC32Update(crc, data, length);
+}
+
+#endif
@@ -0,0 +1,103 @@
+//
+//  DS4Capture.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4Capture_h
+#define DS4_DS4Capture_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Capture files are a header followed by timestamped report records, all
+// little endian:
+//
+//	header:	'D' 'S' '4' 'C', version (u16), transport (u8), variant (u8)
+//	record:	timestamp ns (u64), direction (u8), reserved (u8), length (u16), bytes
+//
+// Only byte buffers are handled here so the same code serves the driver and
+// the host tools.
+
+#define kDS4CaptureVersion			1
+#define kDS4CaptureHeaderLength		8
+#define kDS4CaptureRecordHeaderLength	12
+
+enum DS4CaptureDirection {
+	kDS4CaptureInput,
+	kDS4CaptureOutput,
+	kDS4CaptureFeatureGet,
+	kDS4CaptureFeatureSet
+};
+
+struct DS4CaptureRecord {
+	uint64_t		timestamp;
+	uint8_t			direction;
+	uint16_t		length;
+	const uint8_t	*bytes;
+};
+
+static inline void DS4CaptureWriteHeader(uint8_t *out, uint8_t transport, uint8_t variant)
+{
+	out[0] = 'D';
+	out[1] = 'S';
+	out[2] = '4';
+	out[3] = 'C';
+	out[4] = kDS4CaptureVersion & 0xFF;
+	out[5] = kDS4CaptureVersion >> 8;
+	out[6] = transport;
+	out[7] = variant;
+}
+
+static inline bool DS4CaptureReadHeader(const uint8_t *in, size_t length, uint8_t *transport, uint8_t *variant)
+{
+	if (length < kDS4CaptureHeaderLength || memcmp(in, "DS4C", 4) != 0)
+		return false;
+
+	if ((in[4] | (in[5] << 8)) != kDS4CaptureVersion)
+		return false;
+
+	*transport = in[6];
+	*variant = in[7];
+	return true;
+}
+
+// Writes the record header in front of the report bytes; returns the bytes used.
+static inline size_t DS4CaptureWriteRecordHeader(uint8_t *out, uint64_t timestamp, uint8_t direction, uint16_t length)
+{
+	for (int i = 0; i < 8; i++)
+		out[i] = (uint8_t)(timestamp >> (8 * i));
+	out[8] = direction;
+	out[9] = 0;
+	out[10] = length & 0xFF;
+	out[11] = length >> 8;
+
+	return kDS4CaptureRecordHeaderLength;
+}
+
+// Parses the record at *offset and advances past it. Returns false at the end
+// of the buffer or on a truncated record.
+static inline bool DS4CaptureNextRecord(const uint8_t *in, size_t length, size_t *offset, DS4CaptureRecord *record)
+{
+	size_t at = *offset;
+
+	if (at + kDS4CaptureRecordHeaderLength > length)
+		return false;
+
+	record->timestamp = 0;
+	for (int i = 0; i < 8; i++)
+		record->timestamp |= (uint64_t)in[at + i] << (8 * i);
+	record->direction = in[at + 8];
+	record->length = (uint16_t)(in[at + 10] | (in[at + 11] << 8));
+	record->bytes = in + at + kDS4CaptureRecordHeaderLength;
+
+	if (at + kDS4CaptureRecordHeaderLength + record->length > length)
+		return false;
+
+	*offset = at + kDS4CaptureRecordHeaderLength + record->length;
+	return true;
+}
+
+#endif
@@ -0,0 +1,66 @@
+//
+//  DS4Counters.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4Counters_h
+#define DS4_DS4Counters_h
+
+#include <stdint.h>
+#include <string.h>
+
+enum DS4Counter {
+	kDS4CounterReportsReceived,
+	kDS4CounterReportsDecoded,
+	kDS4CounterReportsDropped,		//	Truncated or failed the CRC check, not delivered
+	kDS4CounterReportsCoalesced,	//	Delivered as part of a batch rather than on their own wakeup
+	kDS4CounterReportsSuppressed,	//	Decoded but intentionally not delivered
+	kDS4CounterOutputsWritten,
+	kDS4CounterFeatureCacheHits,
+	kDS4CounterFeatureCacheMisses,
+	kDS4CounterCRCFailures,
+	kDS4CounterFramesResampled,		//	Reports built for a client's frame clock
+	kDS4CounterReadErrors,			//	Interrupt reads that failed other than by abort
+	kDS4CounterCount
+};
+
+// Names used for the keys of the exported snapshot, indexed by DS4Counter.
+static const char *const DS4CounterNames[kDS4CounterCount] = {
+	"ReportsReceived",
+	"ReportsDecoded",
+	"ReportsDropped",
+	"ReportsCoalesced",
+	"ReportsSuppressed",
+	"OutputsWritten",
+	"FeatureCacheHits",
+	"FeatureCacheMisses",
+	"CRCFailures",
+	"FramesResampled",
+	"ReadErrors"
+};
+
+// Relaxed atomic counters. Writers never wait on each other or on readers,
+// and a snapshot is a set of independent loads, so individual values are
+// exact but not necessarily from the same instant.
+struct DS4Counters {
+	uint64_t	values[kDS4CounterCount];
+
+	void reset(void)
+	{
+		memset(values, 0, sizeof(values));
+	}
+
+	void add(DS4Counter counter, uint64_t amount = 1)
+	{
+		__atomic_fetch_add(&values[counter], amount, __ATOMIC_RELAXED);
+	}
+
+	uint64_t get(DS4Counter counter) const
+	{
+		return __atomic_load_n(&values[counter], __ATOMIC_RELAXED);
+	}
+};
+
+#endif
@@ -0,0 +1,110 @@
+//
+//  DS4FeatureBatch.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4FeatureBatch_h
+#define DS4_DS4FeatureBatch_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "DS4ReportDescriptor.h"
+
+#define kDS4FeatureBatchMax		8
+
+enum DS4FeatureDirection {
+	kDS4FeatureGet,
+	kDS4FeatureSet
+};
+
+// One GET_REPORT or SET_REPORT in a batch. Set buffers start with the ID and
+// must be exactly the report's size; get buffers need at least that much
+// room. status and transferred are filled in as the operation completes.
+struct DS4FeatureOp {
+	uint8_t		direction;		//	DS4FeatureDirection
+	uint8_t		reportID;
+	uint16_t	length;
+	uint8_t		*buffer;
+	int32_t		status;
+	uint16_t	transferred;
+};
+
+// Bookkeeping for a batch of feature report transfers kept a bounded number
+// in flight. claim() hands out the next operation to submit while there is
+// room; complete() records one finishing and says whether it was the last.
+// Both are lock free, since completions can run on another thread while the
+// submitter is still claiming, and either side may end up submitting next.
+struct DS4FeatureBatch {
+	DS4FeatureOp	*ops;
+	uint32_t		count;
+	uint32_t		limit;
+	uint32_t		slots;			//	Claimed << 16 | in flight
+	uint32_t		completed;
+	int32_t			status;			//	First failure, 0 if none
+
+	void reset(DS4FeatureOp *list, uint32_t total, uint32_t inFlight)
+	{
+		ops = list;
+		count = total;
+		limit = inFlight ? inFlight : 1;
+		slots = 0;
+		completed = 0;
+		status = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			ops[i].status = 0;
+			ops[i].transferred = 0;
+		}
+	}
+
+	// Checks every operation against the sizes the descriptor declares.
+	// Returns the index of the first bad one, or -1.
+	int validate(const DS4ReportSizes *sizes) const
+	{
+		for (uint32_t i = 0; i < count; i++) {
+			const DS4FeatureOp *op = &ops[i];
+			uint16_t size = DS4ReportSize(sizes, kDS4ReportKindFeature, op->reportID);
+			if (size == 0 || op->buffer == NULL || op->length < size)
+				return (int)i;
+			if (op->direction == kDS4FeatureSet && (op->length != size || op->buffer[0] != op->reportID))
+				return (int)i;
+		}
+		return -1;
+	}
+
+	// Returns the index of the next operation to submit, or -1 when all have
+	// been handed out or limit are already in flight.
+	int claim(void)
+	{
+		uint32_t current = __atomic_load_n(&slots, __ATOMIC_RELAXED);
+		for (;;) {
+			uint32_t claimed = current >> 16, inFlight = current & 0xFFFF;
+			if (claimed >= count || inFlight >= limit)
+				return -1;
+			if (__atomic_compare_exchange_n(&slots, &current, current + 0x10001, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+				return (int)claimed;
+		}
+	}
+
+	// Returns true for the completion that finishes the batch.
+	bool complete(int index, int32_t outcome, uint16_t transferred)
+	{
+		DS4FeatureOp *op = &ops[index];
+		op->status = outcome;
+		op->transferred = transferred;
+
+		if (outcome != 0) {
+			int32_t none = 0;
+			__atomic_compare_exchange_n(&status, &none, outcome, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		}
+
+		__atomic_fetch_sub(&slots, 1, __ATOMIC_RELEASE);
+		return __atomic_add_fetch(&completed, 1, __ATOMIC_ACQ_REL) == count;
+	}
+
+	int32_t result(void) const		{ return __atomic_load_n(&status, __ATOMIC_ACQUIRE); }
+};
+
+#endif
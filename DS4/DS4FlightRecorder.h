@@ -0,0 +1,162 @@
+//
+//  DS4FlightRecorder.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4FlightRecorder_h
+#define DS4_DS4FlightRecorder_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "DS4Capture.h"
+#include "DS4Report.h"
+
+// Dumps cover kDS4FlightSeconds before the trigger, so the ring has to hold
+// that long at the fastest input rate, the wireless adapter's, with room to
+// spare for output reports.
+#define kDS4FlightSeconds		5
+#define kDS4FlightMaxRateHz		1000
+#define kDS4FlightSlots			8192	//	Power of two; 32 s at 250 Hz, 8 s at 1 kHz
+
+#if kDS4FlightSlots < kDS4FlightSeconds * kDS4FlightMaxRateHz
+#error "The flight recorder ring does not hold a full dump window"
+#endif
+
+#define kDS4FlightSlotBytes		DS4TransportTraits<kDS4TransportUSB>::kReportLength	//	The driver is USB only
+#define kDS4FlightDumpCapacity	(kDS4CaptureHeaderLength + kDS4FlightSlots * (kDS4CaptureRecordHeaderLength + kDS4FlightSlotBytes))
+
+enum DS4FlightTrigger {
+	kDS4FlightTriggerNone,
+	kDS4FlightTriggerChord,			//	The configured buttons went down together
+	kDS4FlightTriggerLatency,		//	Too long since the previous report
+	kDS4FlightTriggerLoss,			//	The pad's report counter skipped ahead
+	kDS4FlightTriggerRequest,		//	Asked for from outside
+	kDS4FlightTriggerCount
+};
+
+static const char *const DS4FlightTriggerNames[kDS4FlightTriggerCount] = {
+	"none",
+	"chord",
+	"latency",
+	"loss",
+	"request"
+};
+
+struct DS4FlightSlot {
+	uint64_t	time;
+	uint32_t	ticket;			//	Reservation + 1 of the record in the slot, 0 while being written
+	uint16_t	length;
+	uint8_t		direction;		//	DS4CaptureDirection
+	uint8_t		reserved;
+	uint8_t		bytes[kDS4FlightSlotBytes];
+};
+
+// The most recent raw reports of one pad, in and out, kept so the moments
+// before a glitch can be written out as a capture after the fact. Recording
+// is a slot reservation and one copy, lock free like DS4TraceBuffer, so input
+// and output paths can both record. dump() copies records out under each
+// slot's ticket and skips any overwritten while it read them, so ingestion
+// never waits on a dump.
+//
+// Times are in whatever clock the caller records with; dump() converts them.
+struct DS4FlightRecorder {
+	DS4FlightSlot	slots[kDS4FlightSlots];
+	uint32_t		head;
+
+	// Trigger configuration and state, only touched from the input path.
+	uint32_t		chord;
+	uint64_t		maxGap;
+	uint8_t			maxLoss;
+	bool			primed;
+	uint32_t		lastButtons;
+	uint64_t		lastArrival;
+	uint8_t			lastCounter;
+
+	void reset(uint32_t chordButtons, uint64_t gap, uint8_t loss)
+	{
+		memset(this, 0, sizeof(*this));
+		chord = chordButtons;
+		maxGap = gap;
+		maxLoss = loss;
+	}
+
+	void record(uint8_t direction, const uint8_t *bytes, size_t length, uint64_t time)
+	{
+		uint32_t ticket = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+		DS4FlightSlot *slot = &slots[ticket & (kDS4FlightSlots - 1)];
+
+		if (length > kDS4FlightSlotBytes)
+			length = kDS4FlightSlotBytes;
+
+		__atomic_store_n(&slot->ticket, 0, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		slot->time = time;
+		slot->length = (uint16_t)length;
+		slot->direction = direction;
+		memcpy(slot->bytes, bytes, length);
+		__atomic_store_n(&slot->ticket, ticket + 1, __ATOMIC_RELEASE);
+	}
+
+	// Looks at a decoded input report for a reason to dump. A zero chord,
+	// gap or loss limit turns that trigger off.
+	DS4FlightTrigger check(const DS4State *state, uint64_t arrival)
+	{
+		DS4FlightTrigger trigger = kDS4FlightTriggerNone;
+
+		if (primed) {
+			uint8_t skipped = (uint8_t)((state->counter - lastCounter - 1) & 0x3F);
+			if (chord != 0 && (state->buttons & chord) == chord && (lastButtons & chord) != chord)
+				trigger = kDS4FlightTriggerChord;
+			else if (maxGap != 0 && arrival - lastArrival > maxGap)
+				trigger = kDS4FlightTriggerLatency;
+			else if (maxLoss != 0 && skipped > maxLoss)
+				trigger = kDS4FlightTriggerLoss;
+		}
+
+		primed = true;
+		lastButtons = state->buttons;
+		lastArrival = arrival;
+		lastCounter = state->counter;
+		return trigger;
+	}
+
+	// Writes the records made at or after since, oldest first, as a capture
+	// file. out must hold kDS4FlightDumpCapacity bytes. Returns the length.
+	size_t dump(uint8_t *out, uint8_t transport, uint8_t variant, uint64_t since, uint64_t (*toNanoseconds)(uint64_t)) const
+	{
+		uint32_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+		uint32_t begin = (end > kDS4FlightSlots) ? end - kDS4FlightSlots : 0;
+		size_t at = kDS4CaptureHeaderLength;
+
+		DS4CaptureWriteHeader(out, transport, variant);
+
+		for (uint32_t ticket = begin; ticket != end; ticket++) {
+			const DS4FlightSlot *slot = &slots[ticket & (kDS4FlightSlots - 1)];
+
+			if (__atomic_load_n(&slot->ticket, __ATOMIC_ACQUIRE) != ticket + 1)
+				continue;
+
+			uint64_t time = slot->time;
+			uint16_t length = slot->length;
+			uint8_t direction = slot->direction;
+			if (length > kDS4FlightSlotBytes)
+				continue;
+			memcpy(out + at + kDS4CaptureRecordHeaderLength, slot->bytes, length);
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot->ticket, __ATOMIC_RELAXED) != ticket + 1 || time < since)
+				continue;
+
+			DS4CaptureWriteRecordHeader(out + at, toNanoseconds ? toNanoseconds(time) : time, direction, length);
+			at += kDS4CaptureRecordHeaderLength + length;
+		}
+
+		return at;
+	}
+};
+
+#endif
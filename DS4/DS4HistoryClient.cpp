@@ -0,0 +1,63 @@
+//
+//  DS4HistoryClient.cpp
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#include <IOKit/IOLib.h>
+
+#include "DS4HistoryClient.h"
+#include "DS4.h"
+
+OSDefineMetaClassAndStructors(DS4HistoryClient, IOUserClient)
+
+#define super IOUserClient
+
+// The history holds every button press and touch, so it is not handed to
+// just any task.
+bool DS4HistoryClient::initWithTask(task_t owningTask, void *securityID, UInt32 type, OSDictionary *properties)
+{
+	if (type != kDS4HistoryClientType)
+		return false;
+	
+	if (clientHasPrivilege(owningTask, kIOClientPrivilegeAdministrator) != kIOReturnSuccess)
+		return false;
+	
+	if (!super::initWithTask(owningTask, securityID, type, properties))
+		return false;
+	
+	fPad = NULL;
+	return true;
+}
+
+bool DS4HistoryClient::start(IOService *provider)
+{
+	fPad = OSDynamicCast(SonyPlaystationDualShock4, provider);
+	if (fPad == NULL)
+		return false;
+	
+	return super::start(provider);
+}
+
+IOReturn DS4HistoryClient::clientClose(void)
+{
+	terminate();
+	return kIOReturnSuccess;
+}
+
+// The mapping keeps its own reference to the descriptor, so the history
+// outlives a pad that goes away while it is still mapped.
+IOReturn DS4HistoryClient::clientMemoryForType(UInt32 type, IOOptionBits *options, IOMemoryDescriptor **memory)
+{
+	if (type != 0 || fPad == NULL)
+		return kIOReturnBadArgument;
+	
+	IOMemoryDescriptor *history = fPad->copyHistoryMemory();
+	if (history == NULL)
+		return kIOReturnNotReady;
+	
+	*options = kIOMapReadOnly;
+	*memory = history;
+	return kIOReturnSuccess;
+}
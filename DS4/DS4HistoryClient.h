@@ -0,0 +1,33 @@
+//
+//  DS4HistoryClient.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4HistoryClient_h
+#define DS4_DS4HistoryClient_h
+
+#include <IOKit/IOUserClient.h>
+
+class SonyPlaystationDualShock4;
+
+// Opened with IOServiceOpen(pad, task, kDS4HistoryClientType, ...). Its only
+// job is to hand the pad's DS4InputHistory to IOConnectMapMemory read only;
+// readers then query it directly with the functions in DS4InputHistory.h and
+// never call back into the kext.
+class DS4HistoryClient : public IOUserClient
+{
+	OSDeclareDefaultStructors(DS4HistoryClient)
+	
+public:
+	virtual bool initWithTask(task_t owningTask, void *securityID, UInt32 type, OSDictionary *properties);
+	virtual bool start(IOService *provider);
+	virtual IOReturn clientClose(void);
+	virtual IOReturn clientMemoryForType(UInt32 type, IOOptionBits *options, IOMemoryDescriptor **memory);
+	
+private:
+	SonyPlaystationDualShock4 *fPad;
+};
+
+#endif
@@ -0,0 +1,94 @@
+//
+//  DS4Identity.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4Identity_h
+#define DS4_DS4Identity_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define kDS4FeatureCalibration		0x02	//	Motion sensor calibration, 37 bytes
+#define kDS4FeaturePairingInfo		0x12	//	Pad and paired host MAC, 16 bytes
+#define kDS4FeatureMACAddress		0x81	//	Pad MAC only, 7 bytes
+#define kDS4FeatureFirmwareInfo		0xA3	//	Build date/time, hardware and firmware versions, 49 bytes
+
+#define kDS4CalibrationLength		37
+#define kDS4PairingInfoLength		16
+#define kDS4MACAddressLength		7
+#define kDS4FirmwareInfoLength		49
+
+enum {
+	kDS4IdentityHasMAC			= 0x01,
+	kDS4IdentityHasHostMAC		= 0x02,
+	kDS4IdentityHasFirmware		= 0x04
+};
+
+// What a pad reports about itself, gathered once per attach. MAC addresses
+// are kept in the order the pad sends them, least significant byte first.
+struct DS4DeviceIdentity {
+	uint8_t		mac[6];
+	uint8_t		hostMAC[6];
+	uint16_t	hardwareVersion;
+	uint16_t	firmwareVersion;
+	char		buildDate[12];		//	"Sep 21 2018"
+	char		buildTime[9];		//	"04:50:51"
+	uint8_t		flags;
+};
+
+static inline bool DS4DecodePairingInfo(const uint8_t *report, size_t length, DS4DeviceIdentity *identity)
+{
+	if (length < kDS4PairingInfoLength || report[0] != kDS4FeaturePairingInfo)
+		return false;
+
+	memcpy(identity->mac, report + 1, 6);
+	memcpy(identity->hostMAC, report + 10, 6);
+	identity->flags |= kDS4IdentityHasMAC | kDS4IdentityHasHostMAC;
+	return true;
+}
+
+static inline bool DS4DecodeMACAddress(const uint8_t *report, size_t length, DS4DeviceIdentity *identity)
+{
+	if (length < kDS4MACAddressLength || report[0] != kDS4FeatureMACAddress)
+		return false;
+
+	memcpy(identity->mac, report + 1, 6);
+	identity->flags |= kDS4IdentityHasMAC;
+	return true;
+}
+
+static inline bool DS4DecodeFirmwareInfo(const uint8_t *report, size_t length, DS4DeviceIdentity *identity)
+{
+	if (length < kDS4FirmwareInfoLength || report[0] != kDS4FeatureFirmwareInfo)
+		return false;
+
+	// Both strings sit in 16 byte NUL padded fields.
+	memcpy(identity->buildDate, report + 1, sizeof(identity->buildDate) - 1);
+	identity->buildDate[sizeof(identity->buildDate) - 1] = '\0';
+	memcpy(identity->buildTime, report + 17, sizeof(identity->buildTime) - 1);
+	identity->buildTime[sizeof(identity->buildTime) - 1] = '\0';
+
+	identity->hardwareVersion = (uint16_t)(report[35] | (report[36] << 8));
+	identity->firmwareVersion = (uint16_t)(report[41] | (report[42] << 8));
+	identity->flags |= kDS4IdentityHasFirmware;
+	return true;
+}
+
+// Formats the pad MAC most significant byte first, "aa:bb:cc:dd:ee:ff".
+static inline void DS4FormatMAC(const uint8_t mac[6], char out[18])
+{
+	static const char digits[] = "0123456789abcdef";
+
+	for (int i = 0; i < 6; i++) {
+		uint8_t byte = mac[5 - i];
+		out[i * 3] = digits[byte >> 4];
+		out[i * 3 + 1] = digits[byte & 0xF];
+		out[i * 3 + 2] = (i == 5) ? '\0' : ':';
+	}
+}
+
+#endif
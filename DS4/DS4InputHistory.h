@@ -0,0 +1,248 @@
+//
+//  DS4InputHistory.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4InputHistory_h
+#define DS4_DS4InputHistory_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "DS4Report.h"
+
+#define kDS4HistorySlots		1024		//	Power of two; 4 s at 250 Hz, 1 s at 1 kHz
+#define kDS4HistoryMagic		0x44533448	//	'DS4H'
+#define kDS4HistoryVersion		2
+#define kDS4HistoryClientType	kDS4HistoryMagic	//	IOServiceOpen type that maps the history
+#define kDS4HistoryReadTries	4
+#define kDS4HistoryNone			UINT64_MAX	//	No such index
+
+struct DS4HistoryEntry {
+	uint64_t	time;			//	Host uptime, ns
+	uint64_t	index;			//	Records made before this one
+	uint64_t	counter;		//	The pad's 6 bit report counter, unwrapped
+	DS4State	state;
+};
+
+struct DS4HistorySlot {
+	uint32_t		sequence;	//	Odd while being written; only compared for equality
+	uint32_t		reserved;
+	DS4HistoryEntry	entry;
+};
+
+// The decoded states of one pad's most recent reports, for callers that need
+// the input as it was at some earlier moment, such as rollback netcode
+// replaying a past tick. One writer records; any number of readers look up
+// an entry by index in O(1), or by time or report counter in O(log n) since
+// both only ever grow. Each slot is a seqlock, so readers never block the
+// writer and simply retry, or give up on an entry that has been overwritten.
+//
+// The layout is fixed and shared with user space, which maps it read only
+// through a kDS4HistoryClientType connection and uses these same functions.
+// Indexes and counters are 64 bit so they never wrap; at 1 kHz a 32 bit
+// index would wrap after about 49 days, and every comparison here would break.
+struct DS4InputHistory {
+	uint32_t		magic;
+	uint16_t		version;
+	uint16_t		entryLength;	//	sizeof(DS4HistoryEntry) as built
+	uint32_t		slotCount;
+	uint32_t		reserved;
+	uint64_t		head;			//	Records made; the newest is head - 1
+	uint64_t		lastCounter;	//	Writer only
+	uint64_t		reserved2;
+	DS4HistorySlot	slots[kDS4HistorySlots];
+
+	void reset(void)
+	{
+		memset(this, 0, sizeof(*this));
+		magic = kDS4HistoryMagic;
+		version = kDS4HistoryVersion;
+		entryLength = sizeof(DS4HistoryEntry);
+		slotCount = kDS4HistorySlots;
+	}
+
+	// Writer side. time must not go backwards.
+	void record(const DS4State *state, uint64_t time)
+	{
+		uint64_t index = __atomic_load_n(&head, __ATOMIC_RELAXED);
+		DS4HistorySlot *slot = &slots[index & (kDS4HistorySlots - 1)];
+
+		// A repeated counter is a full lap, not a duplicate.
+		uint64_t counter = state->counter;
+		if (index != 0) {
+			uint64_t step = (state->counter - lastCounter) & 0x3F;
+			counter = lastCounter + (step ? step : 64);
+		}
+		lastCounter = counter;
+
+		uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		slot->entry.time = time;
+		slot->entry.index = index;
+		slot->entry.counter = counter;
+		slot->entry.state = *state;
+		__atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+		__atomic_store_n(&head, index + 1, __ATOMIC_RELEASE);
+	}
+
+	uint64_t count(void) const		{ return __atomic_load_n(&head, __ATOMIC_ACQUIRE); }
+
+	// Oldest index still safe to read. The slot after the newest is left out,
+	// since the writer may be overwriting it.
+	uint64_t oldest(void) const
+	{
+		uint64_t end = count();
+		return (end >= kDS4HistorySlots) ? end - kDS4HistorySlots + 1 : 0;
+	}
+
+	// Copies out the entry at index. False when it is not recorded yet, has
+	// been overwritten, or kept changing under the reader.
+	bool read(uint64_t index, DS4HistoryEntry *out) const
+	{
+		const DS4HistorySlot *slot = &slots[index & (kDS4HistorySlots - 1)];
+
+		for (int tries = 0; tries < kDS4HistoryReadTries; tries++) {
+			uint32_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+			if (before & 1)
+				continue;
+			*out = slot->entry;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != before)
+				continue;
+			return out->index == index && index < count();
+		}
+		return false;
+	}
+
+	// The newest entry with time at or before t.
+	bool stateAt(uint64_t t, DS4HistoryEntry *out) const
+	{
+		return readFound(search(t, false), out);
+	}
+
+	// The entry for a report counter value as unwrapped by record(). False
+	// if that report was lost or is no longer held.
+	bool atCounter(uint64_t counter, DS4HistoryEntry *out) const
+	{
+		return readFound(search(counter, true), out) && out->counter == counter;
+	}
+
+	// Copies the entries with from <= time <= to, oldest first, up to max.
+	// Returns how many were copied.
+	size_t range(uint64_t from, uint64_t to, DS4HistoryEntry *out, size_t max) const
+	{
+		size_t copied = 0;
+		for (uint64_t index = first(from); copied < max && read(index, &out[copied]); index++) {
+			if (out[copied].time > to)
+				break;
+			copied++;
+		}
+		return copied;
+	}
+
+	// Buttons that went down and came up after from, up to and including to,
+	// judged against the state at from. Physical buttons in the low bits,
+	// virtual ones from DS4State::virtualButtons in pressed/released[1].
+	// False if part of the span is no longer held or was overwritten while
+	// it was walked.
+	bool edges(uint64_t from, uint64_t to, uint32_t pressed[2], uint32_t released[2]) const
+	{
+		DS4HistoryEntry entry;
+		uint32_t last[2] = { 0, 0 };
+
+		pressed[0] = pressed[1] = released[0] = released[1] = 0;
+		// With nothing at or before from, the span starts before the first
+		// record, unless older entries have already been overwritten.
+		uint64_t index = search(from, false);
+		if (index != kDS4HistoryNone) {
+			if (!read(index, &entry))
+				return false;
+			last[0] = entry.state.buttons;
+			last[1] = entry.state.virtualButtons;
+			index++;
+		} else if (oldest() != 0) {
+			return false;
+		} else {
+			index = 0;
+		}
+
+		for (; index < count(); index++) {
+			if (!read(index, &entry))
+				return false;
+			if (entry.time > to)
+				break;
+
+			uint32_t now[2] = { entry.state.buttons, entry.state.virtualButtons };
+			for (int i = 0; i < 2; i++) {
+				pressed[i] |= now[i] & ~last[i];
+				released[i] |= last[i] & ~now[i];
+				last[i] = now[i];
+			}
+		}
+		return true;
+	}
+
+private:
+	// read() for just the key a search compares, which is all most probes need.
+	bool readKey(uint64_t index, bool byCounter, uint64_t *key) const
+	{
+		const DS4HistorySlot *slot = &slots[index & (kDS4HistorySlots - 1)];
+
+		for (int tries = 0; tries < kDS4HistoryReadTries; tries++) {
+			uint32_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+			if (before & 1)
+				continue;
+			uint64_t held = slot->entry.index;
+			*key = byCounter ? slot->entry.counter : slot->entry.time;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != before)
+				continue;
+			return held == index && index < count();
+		}
+		return false;
+	}
+
+	// Index of the newest entry whose key is at or before key, or kDS4HistoryNone.
+	// An entry overwritten mid-search is older than anything still held, so
+	// the search carries on above it.
+	uint64_t search(uint64_t key, bool byCounter) const
+	{
+		uint64_t low = oldest(), high = count();
+		uint64_t found = kDS4HistoryNone;
+
+		while (low < high) {
+			uint64_t middle = low + (high - low) / 2;
+			uint64_t probe;
+			if (!readKey(middle, byCounter, &probe)) {
+				low = middle + 1;
+				continue;
+			}
+			if (probe <= key) {
+				found = middle;
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+		return found;
+	}
+
+	// Index of the oldest entry at or after t.
+	uint64_t first(uint64_t t) const
+	{
+		uint64_t before = (t != 0) ? search(t - 1, false) : kDS4HistoryNone;
+		return (before != kDS4HistoryNone) ? before + 1 : oldest();
+	}
+
+	bool readFound(uint64_t index, DS4HistoryEntry *out) const
+	{
+		return index != kDS4HistoryNone && read(index, out);
+	}
+};
+
+#endif
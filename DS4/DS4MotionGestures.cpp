@@ -0,0 +1,153 @@
+//
+//  DS4MotionGestures.cpp
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#include <string.h>
+
+#include "DS4MotionGestures.h"
+
+#define kNanosecondsPerMS	1000000ULL
+
+#define kMotionButtons		(kDS4VirtualShake | kDS4VirtualFlickLeft | kDS4VirtualFlickRight | \
+							 kDS4VirtualTiltLeft | kDS4VirtualTiltRight | \
+							 kDS4VirtualTiltForward | kDS4VirtualTiltBack)
+
+#define kTiltShift			6		//	log2(kDS4TiltWindow)
+
+const DS4MotionGestureConfig DS4DefaultMotionGestureConfig = {
+	80 * kNanosecondsPerMS,		//	pulseTime
+	400 * kNanosecondsPerMS,	//	refractoryTime
+	12000,						//	shakeThreshold, a 1 g shake at about 3 Hz
+	32000,						//	flickThreshold, about 250 degrees/s held for the window
+	3500,						//	tiltThreshold, about 25 degrees
+	500							//	tiltHysteresis
+};
+
+static inline int32_t Abs(int32_t value)
+{
+	return value < 0 ? -value : value;
+}
+
+// atan(z) ~ pi/4 z + 0.273 z (1 - z) for 0 <= z <= 1, accurate to about 0.2
+// degrees, folded out to the full circle.
+int32_t DS4Atan2(int32_t x, int32_t y)
+{
+	int32_t ax = Abs(x), ay = Abs(y);
+
+	if (ax == 0 && ay == 0)
+		return 0;
+
+	bool swapped = ax > ay;
+	int64_t z = swapped ? ((int64_t)ay << 15) / ax : ((int64_t)ax << 15) / ay;
+	int32_t angle = (int32_t)((z * 8192 + ((z * 2847) >> 15) * (32768 - z)) >> 15);
+
+	if (swapped)
+		angle = 16384 - angle;
+	if (y < 0)
+		angle = 32768 - angle;
+	return x < 0 ? -angle : angle;
+}
+
+static inline int16_t ClampAxis(int32_t value)
+{
+	return (int16_t)(value > 32767 ? 32767 : value < -32767 ? -32767 : value);
+}
+
+void DS4MotionGestures::reset(const DS4MotionGestureConfig *config)
+{
+	memset(this, 0, sizeof(*this));
+	fConfig = *config;
+}
+
+void DS4MotionGestures::process(DS4State *state, uint64_t now)
+{
+	uint32_t slot = fSamples;
+
+	// Shake: total change in acceleration across the window.
+	uint32_t jerk = 0;
+	if (fSamples != 0) {
+		for (int axis = 0; axis < 3; axis++)
+			jerk += Abs(state->accel[axis] - fLastAccel[axis]);
+	}
+	if (jerk > 0xFFFF)
+		jerk = 0xFFFF;
+	fJerkSum += jerk - fJerk[slot % kDS4ShakeWindow];
+	fJerk[slot % kDS4ShakeWindow] = (uint16_t)jerk;
+
+	// Flick: yaw rate integrated over a short window, i.e. how far the wrist
+	// turned in the last few reports.
+	fYawSum += state->gyro[1] - fYaw[slot % kDS4FlickWindow];
+	fYaw[slot % kDS4FlickWindow] = state->gyro[1];
+
+	// Tilt and steering: the gravity direction, taken as the mean acceleration.
+	int16_t *accel = fAccel[slot % kDS4TiltWindow];
+	for (int axis = 0; axis < 3; axis++) {
+		fAccelSum[axis] += state->accel[axis] - accel[axis];
+		accel[axis] = state->accel[axis];
+		fLastAccel[axis] = state->accel[axis];
+	}
+	fSamples++;
+
+	state->virtualButtons &= ~kMotionButtons;
+
+	// Hold off until the windows have filled, so start-up is not a gesture.
+	if (fSamples < kDS4TiltWindow) {
+		state->virtualAxes[kDS4AxisTiltX] = 0;
+		state->virtualAxes[kDS4AxisTiltY] = 0;
+		state->virtualAxes[kDS4AxisSteering] = 0;
+		return;
+	}
+
+	if (now >= fQuietUntil) {
+		if (fJerkSum >= fConfig.shakeThreshold)
+			pulse(kDS4VirtualShake, now);
+		else if (fYawSum >= fConfig.flickThreshold)
+			pulse(kDS4VirtualFlickRight, now);
+		else if (fYawSum <= -fConfig.flickThreshold)
+			pulse(kDS4VirtualFlickLeft, now);
+	}
+
+	int32_t meanX = fAccelSum[0] >> kTiltShift;
+	int32_t meanY = fAccelSum[1] >> kTiltShift;
+	int32_t meanZ = fAccelSum[2] >> kTiltShift;
+
+	// Each tilt needs to pass the threshold to press and fall back past it by
+	// the hysteresis to release, so it does not chatter at the boundary.
+	const struct { uint32_t button; int32_t value; } tilts[] = {
+		{ kDS4VirtualTiltRight, meanX },
+		{ kDS4VirtualTiltLeft, -meanX },
+		{ kDS4VirtualTiltForward, meanZ },
+		{ kDS4VirtualTiltBack, -meanZ }
+	};
+	for (unsigned i = 0; i < sizeof(tilts) / sizeof(tilts[0]); i++) {
+		if (tilts[i].value >= fConfig.tiltThreshold)
+			fTilted |= tilts[i].button;
+		else if (tilts[i].value < fConfig.tiltThreshold - fConfig.tiltHysteresis)
+			fTilted &= ~tilts[i].button;
+	}
+
+	state->virtualAxes[kDS4AxisTiltX] = ClampAxis(meanX * 4);
+	state->virtualAxes[kDS4AxisTiltY] = ClampAxis(meanZ * 4);
+
+	// Held upright like a wheel, turning moves gravity around the X/Y plane.
+	// A quarter turn either way is full lock.
+	state->virtualAxes[kDS4AxisSteering] = ClampAxis(DS4Atan2(meanX, meanY) * 2);
+
+	state->virtualButtons |= fTilted;
+	if (fPulsed != 0) {
+		if (now < fPulseEnd)
+			state->virtualButtons |= fPulsed;
+		else
+			fPulsed = 0;
+	}
+}
+
+void DS4MotionGestures::pulse(uint32_t buttons, uint64_t now)
+{
+	fPulsed |= buttons;
+	fPulseEnd = now + fConfig.pulseTime;
+	fQuietUntil = now + fConfig.refractoryTime;
+}
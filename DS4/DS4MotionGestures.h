@@ -0,0 +1,66 @@
+//
+//  DS4MotionGestures.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4MotionGestures_h
+#define DS4_DS4MotionGestures_h
+
+#include <stdint.h>
+
+#include "DS4Report.h"
+
+// Window lengths in samples. Powers of two, so means are shifts.
+#define kDS4ShakeWindow		32		//	128 ms at 250 Hz
+#define kDS4FlickWindow		8		//	32 ms at 250 Hz
+#define kDS4TiltWindow		64		//	256 ms at 250 Hz, longer than a shake stroke
+
+// Accelerometer units are 8192 per g, gyro units about 16 per degree/s.
+struct DS4MotionGestureConfig {
+	uint64_t	pulseTime;			//	How long shakes and flicks stay pressed, ns
+	uint64_t	refractoryTime;		//	Quiet time after a shake or flick, ns
+	uint32_t	shakeThreshold;		//	Summed change in acceleration over the shake window
+	int32_t		flickThreshold;		//	Summed yaw rate over the flick window
+	int16_t		tiltThreshold;		//	Mean acceleration off the resting axis
+	int16_t		tiltHysteresis;
+};
+
+extern const DS4MotionGestureConfig DS4DefaultMotionGestureConfig;
+
+// Binary angle of (x, y) from the positive y axis, 65536 to a turn.
+int32_t DS4Atan2(int32_t x, int32_t y);
+
+// Streaming recognizer for shakes, wrist flicks, tilt and a steering wheel
+// angle. Every statistic is a running sum over a fixed ring of samples, so
+// each report costs the same however long the windows are.
+class DS4MotionGestures
+{
+public:
+	void reset(const DS4MotionGestureConfig *config = &DS4DefaultMotionGestureConfig);
+	void process(DS4State *state, uint64_t now);
+
+private:
+	void pulse(uint32_t buttons, uint64_t now);
+
+	DS4MotionGestureConfig fConfig;
+	uint32_t	fSamples;
+
+	int16_t		fLastAccel[3];
+	uint16_t	fJerk[kDS4ShakeWindow];
+	uint32_t	fJerkSum;
+
+	int16_t		fYaw[kDS4FlickWindow];
+	int32_t		fYawSum;
+
+	int16_t		fAccel[kDS4TiltWindow][3];
+	int32_t		fAccelSum[3];
+
+	uint32_t	fTilted;			//	Tilt buttons currently held
+	uint32_t	fPulsed;
+	uint64_t	fPulseEnd;
+	uint64_t	fQuietUntil;
+};
+
+#endif
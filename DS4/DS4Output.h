@@ -0,0 +1,144 @@
+//
+//  DS4Output.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4Output_h
+#define DS4_DS4Output_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "DS4Variants.h"
+#include "DS4CRC32.h"
+
+// Fields of the output report, as the bits of its first payload byte. The pad
+// only applies the fields whose bit is set, so a report that changes the
+// light bar leaves the motors alone.
+enum {
+	kDS4OutputRumble	= 1 << 0,
+	kDS4OutputLight		= 1 << 1,
+	kDS4OutputFlash		= 1 << 2,
+	kDS4OutputAll		= kDS4OutputRumble | kDS4OutputLight | kDS4OutputFlash
+};
+
+// Offsets from the start of the output payload, the same on both transports.
+#define kDS4OutputOffsetFlags		0
+#define kDS4OutputOffsetRumbleWeak	3		//	Right, high frequency motor
+#define kDS4OutputOffsetRumbleStrong	4		//	Left, low frequency motor
+#define kDS4OutputOffsetLight		5		//	Red, green, blue
+#define kDS4OutputOffsetFlash		8		//	On, off; 255 = 2.5 s
+#define kDS4OutputPayloadLength		31
+
+#define kDS4OutputFrameLength		78		//	The Bluetooth report, the larger of the two
+#define kDS4OutputPayload			3
+#define kDS4OutputBluetoothFlags	0xC0	//	HID report with CRC trailer, fastest polling
+
+// The last state sent to the pad, kept as one Bluetooth-sized frame with the
+// payload where report 0x11 has it. The USB report 0x05 is the same frame
+// viewed from two bytes in, so either framing is built in place, without
+// copying the payload. Setters only mark what changed; build() emits nothing
+// until something has.
+//
+// Not thread safe; callers serialize setters and build().
+struct DS4OutputShadow {
+	uint8_t			frame[kDS4OutputFrameLength];
+	uint8_t			transport;
+	uint8_t			dirty;
+
+	void reset(DS4Transport t)
+	{
+		memset(frame, 0, sizeof(frame));
+		transport = (uint8_t)t;
+		dirty = 0;
+
+		const DS4OutputLayout *layout = &DS4OutputLayouts[transport];
+		frame[kDS4OutputPayload - layout->payloadOffset] = layout->reportID;
+		if (transport == kDS4TransportBluetooth)
+			frame[1] = kDS4OutputBluetoothFlags;
+	}
+
+	uint8_t *payload(void)
+	{
+		return frame + kDS4OutputPayload;
+	}
+
+	void setRumble(uint8_t strong, uint8_t weak)
+	{
+		set(kDS4OutputRumble, kDS4OutputOffsetRumbleWeak, weak);
+		set(kDS4OutputRumble, kDS4OutputOffsetRumbleStrong, strong);
+	}
+
+	void setLight(uint8_t red, uint8_t green, uint8_t blue)
+	{
+		set(kDS4OutputLight, kDS4OutputOffsetLight + 0, red);
+		set(kDS4OutputLight, kDS4OutputOffsetLight + 1, green);
+		set(kDS4OutputLight, kDS4OutputOffsetLight + 2, blue);
+	}
+
+	void setFlash(uint8_t on, uint8_t off)
+	{
+		set(kDS4OutputFlash, kDS4OutputOffsetFlash + 0, on);
+		set(kDS4OutputFlash, kDS4OutputOffsetFlash + 1, off);
+	}
+
+	// Takes the fields a client's own output payload asks for, honouring its
+	// flags, so reports written through the HID stack merge with the shadow.
+	void merge(const uint8_t *in, size_t length)
+	{
+		if (length <= kDS4OutputOffsetFlash + 1)
+			return;
+
+		uint8_t flags = in[kDS4OutputOffsetFlags];
+		if (flags & kDS4OutputRumble)
+			setRumble(in[kDS4OutputOffsetRumbleStrong], in[kDS4OutputOffsetRumbleWeak]);
+		if (flags & kDS4OutputLight)
+			setLight(in[kDS4OutputOffsetLight], in[kDS4OutputOffsetLight + 1], in[kDS4OutputOffsetLight + 2]);
+		if (flags & kDS4OutputFlash)
+			setFlash(in[kDS4OutputOffsetFlash], in[kDS4OutputOffsetFlash + 1]);
+	}
+
+	// Forces every field out with the next build, e.g. after the pad reconnects.
+	void invalidate(void)
+	{
+		dirty = kDS4OutputAll;
+	}
+
+	// Frames the shadow for its transport and clears the dirty bits. Returns
+	// the report to send, which points into the shadow, or NULL when nothing
+	// changed since the last one.
+	const uint8_t *build(size_t *length)
+	{
+		if (dirty == 0)
+			return NULL;
+
+		const DS4OutputLayout *layout = &DS4OutputLayouts[transport];
+		uint8_t *report = frame + kDS4OutputPayload - layout->payloadOffset;
+
+		payload()[kDS4OutputOffsetFlags] = dirty;
+		dirty = 0;
+
+		if (transport == kDS4TransportBluetooth) {
+			uint32_t crc = DS4CRC32(kDS4CRC32SeedOutput, report, layout->length - 4);
+			for (int i = 0; i < 4; i++)
+				report[layout->length - 4 + i] = (uint8_t)(crc >> (8 * i));
+		}
+
+		*length = layout->length;
+		return report;
+	}
+
+private:
+	void set(uint8_t field, unsigned offset, uint8_t value)
+	{
+		if (payload()[offset] != value) {
+			payload()[offset] = value;
+			dirty |= field;
+		}
+	}
+};
+
+#endif
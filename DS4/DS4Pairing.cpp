@@ -0,0 +1,111 @@
+//
+//  DS4Pairing.cpp
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#include <string.h>
+
+#include "DS4Pairing.h"
+
+// Report 0x13: ID, host MAC least significant byte first, link key.
+void DS4EncodeSetPairing(const uint8_t hostMAC[6], const uint8_t linkKey[kDS4LinkKeyLength], uint8_t *out)
+{
+	out[0] = kDS4FeatureSetPairing;
+	memcpy(out + 1, hostMAC, 6);
+	memcpy(out + 7, linkKey, kDS4LinkKeyLength);
+}
+
+void DS4PairingStation::reset(const uint8_t hostMAC[6], const uint8_t linkKey[kDS4LinkKeyLength], unsigned retries)
+{
+	memcpy(fHostMAC, hostMAC, sizeof(fHostMAC));
+	memcpy(fLinkKey, linkKey, sizeof(fLinkKey));
+	fRetries = retries;
+}
+
+void DS4PairingStation::begin(DS4PairingPad *pad, uint64_t now, const DS4DeviceIdentity *known) const
+{
+	memset(pad, 0, sizeof(*pad));
+	pad->step = kDS4PairingReadIdentity;
+	pad->started = now;
+
+	if (known != NULL && (known->flags & kDS4IdentityHasMAC)) {
+		pad->identity = *known;
+		pad->step = kDS4PairingWriteLinkKey;
+	}
+}
+
+bool DS4PairingStation::next(DS4PairingPad *pad, DS4PairingRequest *request) const
+{
+	switch (pad->step) {
+		case kDS4PairingReadIdentity:
+		case kDS4PairingVerify:
+			memset(pad->buffer, 0, sizeof(pad->buffer));
+			request->direction = kDS4PairingGetReport;
+			request->reportID = kDS4FeaturePairingInfo;
+			request->length = kDS4PairingInfoLength;
+			break;
+		case kDS4PairingWriteLinkKey:
+			DS4EncodeSetPairing(fHostMAC, fLinkKey, pad->buffer);
+			request->direction = kDS4PairingSetReport;
+			request->reportID = kDS4FeatureSetPairing;
+			request->length = kDS4SetPairingLength;
+			break;
+		default:
+			return false;
+	}
+
+	request->buffer = pad->buffer;
+	return true;
+}
+
+// A failed transfer is retried up to fRetries times before the pad fails. A
+// pad that answers but does not take the new host fails straight away.
+void DS4PairingStation::complete(DS4PairingPad *pad, int32_t status, size_t length, uint64_t now) const
+{
+	if (done(pad))
+		return;
+
+	if (status != 0 || (pad->step != kDS4PairingWriteLinkKey && length < kDS4PairingInfoLength)) {
+		if (++pad->attempts > fRetries)
+			fail(pad, status, now);
+		return;
+	}
+
+	switch (pad->step) {
+		case kDS4PairingReadIdentity:
+			if (!DS4DecodePairingInfo(pad->buffer, length, &pad->identity)) {
+				fail(pad, 0, now);
+				return;
+			}
+			pad->step = kDS4PairingWriteLinkKey;
+			break;
+		case kDS4PairingWriteLinkKey:
+			pad->step = kDS4PairingVerify;
+			break;
+		case kDS4PairingVerify: {
+			DS4DeviceIdentity check;
+			memset(&check, 0, sizeof(check));
+			if (!DS4DecodePairingInfo(pad->buffer, length, &check) ||
+				memcmp(check.mac, pad->identity.mac, 6) != 0 || memcmp(check.hostMAC, fHostMAC, 6) != 0) {
+				fail(pad, 0, now);
+				return;
+			}
+			memcpy(pad->identity.hostMAC, check.hostMAC, 6);
+			pad->step = kDS4PairingPaired;
+			pad->finished = now;
+			break;
+		}
+	}
+
+	pad->attempts = 0;
+}
+
+void DS4PairingStation::fail(DS4PairingPad *pad, int32_t status, uint64_t now) const
+{
+	pad->failedStep = pad->step;
+	pad->step = kDS4PairingFailed;
+	pad->error = status;
+	pad->finished = now;
+}
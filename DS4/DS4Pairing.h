@@ -0,0 +1,97 @@
+//
+//  DS4Pairing.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4Pairing_h
+#define DS4_DS4Pairing_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "DS4Identity.h"
+
+#define kDS4FeatureSetPairing		0x13	//	Host MAC and link key, 23 bytes
+#define kDS4SetPairingLength		23
+#define kDS4LinkKeyLength			16
+
+// Where a pad is in being paired to a host over USB: read its identity (0x12),
+// write the host and link key (0x13), then read 0x12 back to check the pad
+// took the new host.
+enum DS4PairingStep {
+	kDS4PairingIdle,
+	kDS4PairingReadIdentity,
+	kDS4PairingWriteLinkKey,
+	kDS4PairingVerify,
+	kDS4PairingPaired,
+	kDS4PairingFailed,
+	kDS4PairingStepCount
+};
+
+static const char *const DS4PairingStepNames[kDS4PairingStepCount] = {
+	"idle",
+	"reading",
+	"writing",
+	"verifying",
+	"paired",
+	"failed"
+};
+
+enum DS4PairingDirection {
+	kDS4PairingGetReport,
+	kDS4PairingSetReport
+};
+
+// A control transfer the transport has to run for a pad. buffer points into
+// the pad's own state and stays valid until the transfer is completed.
+struct DS4PairingRequest {
+	uint8_t		direction;		//	DS4PairingDirection
+	uint8_t		reportID;
+	uint16_t	length;
+	uint8_t		*buffer;
+};
+
+struct DS4PairingPad {
+	uint8_t				step;			//	DS4PairingStep
+	uint8_t				failedStep;		//	Step that failed, for kDS4PairingFailed
+	uint8_t				attempts;		//	Tries of the current step
+	int32_t				error;			//	Transport status of the last failure, 0 if the pad misbehaved
+	DS4DeviceIdentity	identity;
+	uint64_t			started;
+	uint64_t			finished;
+	uint8_t				buffer[kDS4SetPairingLength];
+};
+
+// Runs the pairing steps for any number of pads. The station never touches
+// a transport: next() says what a pad needs sent, and the caller feeds the
+// result back with complete() whenever the transfer finishes. A pad has at
+// most one transfer outstanding, since it only has one control pipe, but
+// pads are independent, so callers keep a transfer in flight on every pad at
+// once and the steps of different pads overlap.
+class DS4PairingStation
+{
+public:
+	void reset(const uint8_t hostMAC[6], const uint8_t linkKey[kDS4LinkKeyLength], unsigned retries);
+
+	// A pad whose identity the caller already read starts at the write.
+	void begin(DS4PairingPad *pad, uint64_t now, const DS4DeviceIdentity *known = NULL) const;
+
+	// Fills in the pad's next transfer. Returns false once it is paired or failed.
+	bool next(DS4PairingPad *pad, DS4PairingRequest *request) const;
+	void complete(DS4PairingPad *pad, int32_t status, size_t length, uint64_t now) const;
+
+	static bool done(const DS4PairingPad *pad)	{ return pad->step >= kDS4PairingPaired; }
+
+private:
+	void fail(DS4PairingPad *pad, int32_t status, uint64_t now) const;
+
+	uint8_t		fHostMAC[6];
+	uint8_t		fLinkKey[kDS4LinkKeyLength];
+	unsigned	fRetries;
+};
+
+void DS4EncodeSetPairing(const uint8_t hostMAC[6], const uint8_t linkKey[kDS4LinkKeyLength], uint8_t *out);
+
+#endif
@@ -0,0 +1,238 @@
+//
+//  DS4Report.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4Report_h
+#define DS4_DS4Report_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "DS4Variants.h"
+#include "DS4CRC32.h"
+
+// Button bits, in the order the report descriptor declares Button 1-14.
+enum {
+	kDS4ButtonSquare	= 1 << 0,
+	kDS4ButtonCross		= 1 << 1,
+	kDS4ButtonCircle	= 1 << 2,
+	kDS4ButtonTriangle	= 1 << 3,
+	kDS4ButtonL1		= 1 << 4,
+	kDS4ButtonR1		= 1 << 5,
+	kDS4ButtonL2		= 1 << 6,
+	kDS4ButtonR2		= 1 << 7,
+	kDS4ButtonShare		= 1 << 8,
+	kDS4ButtonOptions	= 1 << 9,
+	kDS4ButtonL3		= 1 << 10,
+	kDS4ButtonR3		= 1 << 11,
+	kDS4ButtonPS		= 1 << 12,
+	kDS4ButtonTouchpad	= 1 << 13
+};
+
+// Controls the driver synthesizes from touch and motion input. They are
+// carried in DS4State next to the physical ones so anything that consumes
+// buttons and axes can treat them the same way.
+enum {
+	kDS4VirtualTap				= 1 << 0,
+	kDS4VirtualDoubleTap		= 1 << 1,
+	kDS4VirtualSwipeLeft		= 1 << 2,	//	Edge swipes, named by direction of travel
+	kDS4VirtualSwipeRight		= 1 << 3,
+	kDS4VirtualSwipeUp			= 1 << 4,
+	kDS4VirtualSwipeDown		= 1 << 5,
+	kDS4VirtualClick			= 1 << 6,
+	kDS4VirtualSecondaryClick	= 1 << 7,	//	Touchpad clicked with two fingers down
+	kDS4VirtualShake			= 1 << 8,
+	kDS4VirtualFlickLeft		= 1 << 9,
+	kDS4VirtualFlickRight		= 1 << 10,
+	kDS4VirtualTiltLeft			= 1 << 11,
+	kDS4VirtualTiltRight		= 1 << 12,
+	kDS4VirtualTiltForward		= 1 << 13,
+	kDS4VirtualTiltBack			= 1 << 14
+};
+
+// Touch zones take the top 16 virtual buttons, zone n at bit 16 + n.
+#define kDS4VirtualZoneShift	16
+#define kDS4VirtualZoneMask		0xFFFF0000U
+
+enum DS4VirtualAxis {
+	kDS4AxisScrollX,
+	kDS4AxisScrollY,
+	kDS4AxisZoom,
+	kDS4AxisTiltX,
+	kDS4AxisTiltY,
+	kDS4AxisSteering,
+	kDS4VirtualAxisCount
+};
+
+#define kDS4HatReleased		8
+#define kDS4TouchCount		2
+#define kDS4TouchMaxX		1919
+#define kDS4TouchMaxY		942
+
+struct DS4Touch {
+	uint8_t		active;
+	uint8_t		id;			//	Tracking id, increments on every new contact
+	uint16_t	x;			//	0 - kDS4TouchMaxX
+	uint16_t	y;			//	0 - kDS4TouchMaxY
+};
+
+struct DS4State {
+	uint8_t		leftX;
+	uint8_t		leftY;
+	uint8_t		rightX;
+	uint8_t		rightY;
+	uint8_t		l2;
+	uint8_t		r2;
+	uint8_t		hat;		//	0 - 7 clockwise from north, kDS4HatReleased when centered
+	uint8_t		counter;	//	6 bit report counter
+	uint32_t	buttons;
+	uint16_t	timestamp;	//	Sensor clock, 16/3 us per tick
+	int16_t		gyro[3];
+	int16_t		accel[3];
+	uint8_t		battery;	//	Low nibble level, 0x10 set while the cable is attached
+	uint8_t		padPresent;
+	uint8_t		touchPacket;
+	DS4Touch	touch[kDS4TouchCount];
+	uint32_t	virtualButtons;
+	int16_t		virtualAxes[kDS4VirtualAxisCount];
+};
+
+enum DS4DecodeResult {
+	kDS4DecodeOK,
+	kDS4DecodeIgnored,		//	Not an input report this decoder handles
+	kDS4DecodeTruncated,
+	kDS4DecodeBadCRC
+};
+
+// Report 0x01 over USB and 0x11 over Bluetooth carry the same payload; only
+// the framing in front of it and the CRC trailer differ.
+template <DS4Transport T> struct DS4TransportTraits;
+
+template <> struct DS4TransportTraits<kDS4TransportUSB> {
+	enum { kReportID = 0x01, kReportLength = 64, kPayload = 1, kHasCRC = 0 };
+};
+
+template <> struct DS4TransportTraits<kDS4TransportBluetooth> {
+	enum { kReportID = 0x11, kReportLength = 78, kPayload = 3, kHasCRC = 1 };
+};
+
+// The wireless adapter keeps reporting with no pad paired to it and flags
+// that in the second status byte.
+template <DS4Variant V> struct DS4VariantTraits {
+	enum { kPadPresence = 0 };
+};
+
+template <> struct DS4VariantTraits<kDS4VariantAdapter> {
+	enum { kPadPresence = 1 };
+};
+
+// Payload offsets, relative to DS4TransportTraits<T>::kPayload.
+enum {
+	kDS4OffsetLeftX			= 0,
+	kDS4OffsetButtons		= 4,
+	kDS4OffsetL2			= 7,
+	kDS4OffsetR2			= 8,
+	kDS4OffsetTimestamp		= 9,
+	kDS4OffsetGyro			= 12,
+	kDS4OffsetAccel			= 18,
+	kDS4OffsetStatus		= 29,
+	kDS4OffsetPresence		= 30,
+	kDS4OffsetTouchPacket	= 33,
+	kDS4OffsetTouch			= 34
+};
+
+#define kDS4PresenceNoPad	0x04
+
+static inline uint16_t DS4ReadLE16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t DS4ReadLE32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+template <DS4Transport T, DS4Variant V>
+struct DS4Decoder {
+	typedef DS4TransportTraits<T> Transport;
+	typedef DS4VariantTraits<V> Variant;
+
+	static DS4DecodeResult decode(const uint8_t *report, size_t length, DS4State *state)
+	{
+		if (length < 1 || report[0] != Transport::kReportID)
+			return kDS4DecodeIgnored;
+
+		if (length < Transport::kReportLength)
+			return kDS4DecodeTruncated;
+
+		if (Transport::kHasCRC) {
+			const size_t covered = Transport::kReportLength - 4;
+			if (DS4CRC32(kDS4CRC32SeedInput, report, covered) != DS4ReadLE32(report + covered))
+				return kDS4DecodeBadCRC;
+		}
+
+		const uint8_t *p = report + Transport::kPayload;
+
+		state->leftX = p[kDS4OffsetLeftX + 0];
+		state->leftY = p[kDS4OffsetLeftX + 1];
+		state->rightX = p[kDS4OffsetLeftX + 2];
+		state->rightY = p[kDS4OffsetLeftX + 3];
+		state->hat = p[kDS4OffsetButtons] & 0x0F;
+		state->buttons = (p[kDS4OffsetButtons] >> 4) |
+						 (p[kDS4OffsetButtons + 1] << 4) |
+						 ((p[kDS4OffsetButtons + 2] & 0x03) << 12);
+		state->counter = p[kDS4OffsetButtons + 2] >> 2;
+		state->l2 = p[kDS4OffsetL2];
+		state->r2 = p[kDS4OffsetR2];
+		state->timestamp = DS4ReadLE16(p + kDS4OffsetTimestamp);
+
+		for (int axis = 0; axis < 3; axis++) {
+			state->gyro[axis] = (int16_t)DS4ReadLE16(p + kDS4OffsetGyro + axis * 2);
+			state->accel[axis] = (int16_t)DS4ReadLE16(p + kDS4OffsetAccel + axis * 2);
+		}
+
+		state->battery = p[kDS4OffsetStatus];
+		state->padPresent = Variant::kPadPresence ? !(p[kDS4OffsetPresence] & kDS4PresenceNoPad) : 1;
+
+		// Reports normally carry a single touch frame; only the first is decoded.
+		state->touchPacket = p[kDS4OffsetTouchPacket];
+		for (int i = 0; i < kDS4TouchCount; i++) {
+			const uint8_t *t = p + kDS4OffsetTouch + i * 4;
+			state->touch[i].active = !(t[0] & 0x80);
+			state->touch[i].id = t[0] & 0x7F;
+			state->touch[i].x = (uint16_t)(t[1] | ((t[2] & 0x0F) << 8));
+			state->touch[i].y = (uint16_t)((t[2] >> 4) | (t[3] << 4));
+		}
+
+		return kDS4DecodeOK;
+	}
+};
+
+typedef DS4DecodeResult (*DS4DecodeFunction)(const uint8_t *report, size_t length, DS4State *state);
+
+// Resolved once when the device starts; the report path only calls through the pointer.
+// The kext only uses the USB row. The Bluetooth row is for host tools
+// decoding captures.
+static inline DS4DecodeFunction DS4SelectDecoder(DS4Transport transport, DS4Variant variant)
+{
+	static const DS4DecodeFunction decoders[kDS4TransportCount][kDS4VariantCount] = {
+		{
+			DS4Decoder<kDS4TransportUSB, kDS4VariantV1>::decode,
+			DS4Decoder<kDS4TransportUSB, kDS4VariantV2>::decode,
+			DS4Decoder<kDS4TransportUSB, kDS4VariantAdapter>::decode
+		},
+		{
+			DS4Decoder<kDS4TransportBluetooth, kDS4VariantV1>::decode,
+			DS4Decoder<kDS4TransportBluetooth, kDS4VariantV2>::decode,
+			DS4Decoder<kDS4TransportBluetooth, kDS4VariantAdapter>::decode
+		}
+	};
+
+	return decoders[transport][variant];
+}
+
+#endif
@@ -0,0 +1,136 @@
+//
+//  DS4ReportDescriptor.cpp
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#include <string.h>
+
+#include "DS4ReportDescriptor.h"
+
+enum {
+	kItemTypeMain		= 0,
+	kItemTypeGlobal		= 1,
+	
+	kMainInput			= 0x8,
+	kMainOutput			= 0x9,
+	kMainCollection		= 0xA,
+	kMainFeature		= 0xB,
+	
+	kMainConstant		= 0x01,
+	
+	kGlobalReportSize	= 0x7,
+	kGlobalReportID		= 0x8,
+	kGlobalReportCount	= 0x9,
+	kGlobalPush			= 0xA,
+	kGlobalPop			= 0xB,
+	
+	kLongItemPrefix		= 0xFE,
+	kGlobalStackDepth	= 4
+};
+
+struct GlobalState {
+	uint32_t	reportSize;
+	uint32_t	reportCount;
+	uint8_t		reportID;
+};
+
+// Walks the short items of a report descriptor and totals the bits each main
+// item contributes to its report. The totals are accumulated in place and
+// converted to bytes once the whole descriptor has been seen.
+bool DS4ParseReportSizes(const uint8_t *descriptor, size_t length, DS4ReportSizes *sizes)
+{
+	GlobalState stack[kGlobalStackDepth];
+	GlobalState global = { 0, 0, 0 };
+	unsigned depth = 0;
+	bool hasReportIDs = false;
+	size_t i = 0;
+	
+	memset(sizes, 0, sizeof(*sizes));
+	
+	while (i < length) {
+		uint8_t prefix = descriptor[i++];
+		
+		if (prefix == kLongItemPrefix) {
+			if (i + 1 >= length)
+				return false;
+			i += 2 + descriptor[i];
+			continue;
+		}
+		
+		size_t size = prefix & 0x3;
+		if (size == 3)
+			size = 4;
+		if (i + size > length)
+			return false;
+		
+		uint32_t data = 0;
+		for (size_t b = 0; b < size; b++)
+			data |= (uint32_t)descriptor[i + b] << (8 * b);
+		i += size;
+		
+		uint8_t type = (prefix >> 2) & 0x3;
+		uint8_t tag = prefix >> 4;
+		
+		if (type == kItemTypeGlobal) {
+			switch (tag) {
+				case kGlobalReportSize:
+					global.reportSize = data;
+					break;
+				case kGlobalReportCount:
+					global.reportCount = data;
+					break;
+				case kGlobalReportID:
+					global.reportID = (uint8_t)data;
+					hasReportIDs = true;
+					break;
+				case kGlobalPush:
+					if (depth == kGlobalStackDepth)
+						return false;
+					stack[depth++] = global;
+					break;
+				case kGlobalPop:
+					if (depth == 0)
+						return false;
+					global = stack[--depth];
+					break;
+			}
+		} else if (type == kItemTypeMain) {
+			DS4ReportKind kind;
+			switch (tag) {
+				case kMainInput:	kind = kDS4ReportKindInput;		break;
+				case kMainOutput:	kind = kDS4ReportKindOutput;	break;
+				case kMainFeature:	kind = kDS4ReportKindFeature;	break;
+				case kMainCollection:
+					sizes->elements++;
+					continue;
+				default:			continue;
+			}
+			
+			// One element per field, the way IOHIDFamily expands report counts.
+			if (!(data & kMainConstant))
+				sizes->elements += global.reportCount;
+			
+			uint32_t bits = sizes->bytes[kind][global.reportID] + global.reportSize * global.reportCount;
+			if (bits > 0xFFFF)
+				return false;
+			sizes->bytes[kind][global.reportID] = (uint16_t)bits;
+		}
+	}
+	
+	for (int kind = 0; kind < kDS4ReportKindCount; kind++) {
+		for (int id = 0; id < 256; id++) {
+			uint16_t bits = sizes->bytes[kind][id];
+			if (bits == 0)
+				continue;
+			
+			uint16_t bytes = (uint16_t)((bits + 7) / 8 + (hasReportIDs ? 1 : 0));
+			sizes->bytes[kind][id] = bytes;
+			if (bytes > sizes->largest)
+				sizes->largest = bytes;
+		}
+	}
+	
+	return true;
+}
@@ -0,0 +1,37 @@
+//
+//  DS4ReportDescriptor.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4ReportDescriptor_h
+#define DS4_DS4ReportDescriptor_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Indexed the same way as IOHIDReportType.
+enum DS4ReportKind {
+	kDS4ReportKindInput,
+	kDS4ReportKindOutput,
+	kDS4ReportKindFeature,
+	kDS4ReportKindCount
+};
+
+// Size in bytes of every report a descriptor declares, including the report
+// ID byte. Zero for IDs the descriptor does not declare.
+struct DS4ReportSizes {
+	uint16_t	bytes[kDS4ReportKindCount][256];
+	uint16_t	largest;
+	uint16_t	elements;		//	Collections plus non-constant fields, roughly what the HID stack builds
+};
+
+bool DS4ParseReportSizes(const uint8_t *descriptor, size_t length, DS4ReportSizes *sizes);
+
+static inline uint16_t DS4ReportSize(const DS4ReportSizes *sizes, DS4ReportKind kind, uint8_t reportID)
+{
+	return sizes->bytes[kind][reportID];
+}
+
+#endif
@@ -0,0 +1,112 @@
+//
+//  DS4ReportModes.cpp
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#include <string.h>
+
+#include "DS4ReportModes.h"
+#include "DS4Report.h"
+
+#ifdef DS4_HAVE_XBOX_SSSE3
+#include <tmmintrin.h>
+#endif
+
+namespace HID_DS4 {
+	#include "dualshock4hid.h"
+}
+
+const DS4ReportModeInfo DS4ReportModes[kDS4ReportModeCount] = {
+	{ "native", HID_DS4::ReportDescriptor, sizeof(HID_DS4::ReportDescriptor), 0, NULL },
+	{ "xbox", HID_DS4::XboxReportDescriptor, sizeof(HID_DS4::XboxReportDescriptor), kDS4XboxReportLength, DS4TranslateXbox },
+	{ "compact", HID_DS4::CompactReportDescriptor, sizeof(HID_DS4::CompactReportDescriptor), 0, NULL },
+	{ "split", HID_DS4::SplitReportDescriptor, sizeof(HID_DS4::SplitReportDescriptor), kDS4SplitReportLength, DS4TranslateSplit }
+};
+
+// Where each of the first 16 bytes after the report ID comes from in the
+// payload, -1 for zero. Sticks become the high byte of a 16 bit axis.
+static const int8_t kXboxShuffle[16] = {
+	-1, kDS4OffsetLeftX + 0,
+	-1, kDS4OffsetLeftX + 1,
+	-1, kDS4OffsetLeftX + 2,
+	-1, kDS4OffsetLeftX + 3,
+	kDS4OffsetL2,
+	kDS4OffsetR2,
+	-1, -1, -1, -1, -1, -1		//	Buttons and hat, filled in below
+};
+
+// Square, cross, circle, triangle to A (cross), B (circle), X (square), Y (triangle).
+static const uint8_t kXboxFace[16] = {
+	0x0, 0x4, 0x1, 0x5, 0x2, 0x6, 0x3, 0x7,
+	0x8, 0xC, 0x9, 0xD, 0xA, 0xE, 0xB, 0xF
+};
+
+// The buttons are bit fields, so they do not fit the byte shuffle. L1/R1 and
+// Share/Options already sit next to each other, L3/R3 and PS move across.
+static inline void XboxButtons(const uint8_t *payload, uint8_t *out)
+{
+	uint8_t face = payload[kDS4OffsetButtons];
+	uint8_t shoulders = payload[kDS4OffsetButtons + 1];
+	uint8_t system = payload[kDS4OffsetButtons + 2];
+
+	out[11] = (uint8_t)(kXboxFace[face >> 4] | (shoulders & 0x03) << 4 | (shoulders & 0x30) << 2);
+	out[12] = (uint8_t)(shoulders >> 6 | (system & 0x01) << 2);
+	out[13] = face & 0x0F;			//	Released (8) is outside 0-7, the null state
+}
+
+size_t DS4TranslateXbox(const uint8_t *payload, uint8_t *out)
+{
+	out[0] = 0x01;
+	for (int i = 0; i < 10; i++)
+		out[1 + i] = kXboxShuffle[i] < 0 ? 0 : payload[kXboxShuffle[i]];
+
+	XboxButtons(payload, out);
+	return kDS4XboxReportLength;
+}
+
+#ifdef DS4_HAVE_XBOX_SSSE3
+__attribute__((target("ssse3")))
+size_t DS4TranslateXboxSSSE3(const uint8_t *payload, uint8_t *out)
+{
+	__m128i mask = _mm_loadu_si128((const __m128i *)kXboxShuffle);
+	__m128i bytes = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)payload), mask);
+	uint8_t shuffled[16];
+
+	_mm_storeu_si128((__m128i *)shuffled, bytes);
+	out[0] = 0x01;
+	memcpy(out + 1, shuffled, 10);
+
+	XboxButtons(payload, out);
+	return kDS4XboxReportLength;
+}
+#endif
+
+// Sticks, hat, buttons, counter and triggers keep their native bytes. Touch
+// points already pack X and Y as 12 bit little endian fields, the way HID
+// does, so only the first byte of each (inverted active bit, ID) changes.
+size_t DS4TranslateSplit(const uint8_t *payload, uint8_t *out)
+{
+	out[0] = 0x01;
+	memcpy(out + 1, payload, kDS4OffsetR2 + 1);
+	memcpy(out + 10, payload + kDS4OffsetAccel, 6);
+	memcpy(out + 16, payload + kDS4OffsetGyro, 6);
+
+	unsigned level = (payload[kDS4OffsetStatus] & 0x0F) * 10;
+	out[22] = (uint8_t)(level > 100 ? 100 : level);
+
+	uint8_t contacts = 0;
+	for (int i = 0; i < kDS4TouchCount; i++) {
+		const uint8_t *touch = payload + kDS4OffsetTouch + i * 4;
+		uint8_t *finger = out + 23 + i * 4;
+		uint8_t active = !(touch[0] & 0x80);
+
+		finger[0] = (uint8_t)(active | (touch[0] & 0x7F) << 1);
+		memcpy(finger + 1, touch + 1, 3);
+		contacts += active;
+	}
+	out[31] = contacts;
+
+	return kDS4SplitReportLength;
+}
@@ -0,0 +1,64 @@
+//
+//  DS4ReportModes.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4ReportModes_h
+#define DS4_DS4ReportModes_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define kDS4XboxReportLength	14		//	ID, 4 x 16 bit sticks, 2 triggers, 16 buttons, hat
+#define kDS4SplitReportLength	32		//	ID, native controls, IMU, battery, 2 touches, contact count
+
+// The layouts the pad can present itself in. Every mode other than native
+// publishes its own report descriptor; those that change the input report
+// have each one rewritten to match before it reaches the HID stack.
+enum DS4ReportMode {
+	kDS4ReportModeNative,
+	kDS4ReportModeXbox,
+	kDS4ReportModeCompact,		//	Native reports, without the vendor feature reports
+	kDS4ReportModeSplit,		//	IMU, battery and touch as standard usages
+	kDS4ReportModeCount
+};
+
+// Rewrites the payload of an input report (the bytes after the transport
+// header) into the mode's report, ID included. Returns the bytes written.
+typedef size_t (*DS4TranslateFunction)(const uint8_t *payload, uint8_t *out);
+
+struct DS4ReportModeInfo {
+	const char				*name;
+	const uint8_t			*descriptor;
+	size_t					descriptorLength;
+	size_t					reportLength;		//	0 when reports pass through untouched
+	DS4TranslateFunction	translate;
+};
+
+extern const DS4ReportModeInfo DS4ReportModes[kDS4ReportModeCount];
+
+static inline const DS4ReportModeInfo *DS4LookupReportMode(const char *name)
+{
+	for (int i = 0; i < kDS4ReportModeCount; i++) {
+		const char *a = DS4ReportModes[i].name, *b = name;
+		while (*a != '\0' && *a == *b)
+			a++, b++;
+		if (*a == *b)
+			return &DS4ReportModes[i];
+	}
+	return NULL;
+}
+
+size_t DS4TranslateXbox(const uint8_t *payload, uint8_t *out);
+size_t DS4TranslateSplit(const uint8_t *payload, uint8_t *out);
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(KERNEL)
+// Same result as DS4TranslateXbox with the byte moves done by one pshufb.
+// Only for host builds, and only on CPUs with SSSE3.
+#define DS4_HAVE_XBOX_SSSE3 1
+size_t DS4TranslateXboxSSSE3(const uint8_t *payload, uint8_t *out);
+#endif
+
+#endif
@@ -0,0 +1,77 @@
+//
+//  DS4ReportPool.cpp
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#include <IOKit/IOLib.h>
+#include <IOKit/IOSubMemoryDescriptor.h>
+
+#include "DS4ReportPool.h"
+
+bool DS4ReportPool::init(UInt32 bufferSize, UInt32 count)
+{
+	bzero(this, sizeof(*this));
+	
+	if (bufferSize == 0 || count == 0 || count > kDS4ReportPoolMaxBuffers)
+		return false;
+	
+	fStride = (bufferSize + kDS4ReportPoolAlignment - 1) & ~(kDS4ReportPoolAlignment - 1);
+	fCount = count;
+	
+	fBuffer = IOBufferMemoryDescriptor::inTaskWithOptions(kernel_task,
+														  kIODirectionInOut,
+														  fStride * fCount,
+														  kDS4ReportPoolAlignment);
+	if (fBuffer == NULL)
+		return false;
+	
+	fBytes = (UInt8 *)fBuffer->getBytesNoCopy();
+	bzero(fBytes, fStride * fCount);
+	
+	for (UInt32 i = 0; i < fCount; i++) {
+		fDescriptors[i] = IOSubMemoryDescriptor::withSubRange(fBuffer, i * fStride, fStride, kIODirectionInOut);
+		if (fDescriptors[i] == NULL) {
+			free();
+			return false;
+		}
+	}
+	
+	fFreeMask = (fCount == 64) ? ~0ULL : ((1ULL << fCount) - 1);
+	
+	return true;
+}
+
+void DS4ReportPool::free(void)
+{
+	for (UInt32 i = 0; i < kDS4ReportPoolMaxBuffers; i++)
+		OSSafeReleaseNULL(fDescriptors[i]);
+	
+	OSSafeReleaseNULL(fBuffer);
+	fBytes = NULL;
+	fFreeMask = 0;
+}
+
+SInt32 DS4ReportPool::acquire(void)
+{
+	UInt64 mask = __atomic_load_n(&fFreeMask, __ATOMIC_RELAXED);
+	
+	do {
+		if (mask == 0) {
+			__atomic_fetch_add(&fExhausted, 1, __ATOMIC_RELAXED);
+			return -1;
+		}
+	} while (!__atomic_compare_exchange_n(&fFreeMask, &mask, mask & (mask - 1), true,
+										  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+	
+	return __builtin_ctzll(mask);
+}
+
+void DS4ReportPool::release(SInt32 index)
+{
+	if (index < 0 || (UInt32)index >= fCount)
+		return;
+	
+	__atomic_fetch_or(&fFreeMask, 1ULL << index, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,46 @@
+//
+//  DS4ReportPool.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4ReportPool_h
+#define DS4_DS4ReportPool_h
+
+#include <IOKit/IOBufferMemoryDescriptor.h>
+
+#define kDS4ReportPoolMaxBuffers	64
+#define kDS4ReportPoolAlignment		64
+
+// Fixed set of report buffers carved out of one allocation made when the
+// device starts. Each buffer starts on its own cache line and comes with a
+// prebuilt memory descriptor, so completions and output requests can be
+// issued without going back to the allocator. Acquire and release are a
+// single compare-and-swap on the free mask and may be called from any context.
+class DS4ReportPool
+{
+public:
+	bool init(UInt32 bufferSize, UInt32 count);
+	void free(void);
+	
+	// Returns a buffer index, or -1 once every buffer is in flight.
+	SInt32 acquire(void);
+	void release(SInt32 index);
+	
+	UInt8 *bytes(SInt32 index) const				{ return fBytes + index * fStride; }
+	IOMemoryDescriptor *descriptor(SInt32 index) const	{ return fDescriptors[index]; }
+	UInt32 bufferSize(void) const					{ return fStride; }
+	UInt32 exhaustedCount(void) const				{ return __atomic_load_n(&fExhausted, __ATOMIC_RELAXED); }
+	
+private:
+	IOBufferMemoryDescriptor *fBuffer;
+	IOMemoryDescriptor *fDescriptors[kDS4ReportPoolMaxBuffers];
+	UInt8 *fBytes;
+	UInt32 fStride;
+	UInt32 fCount;
+	UInt64 fFreeMask;
+	UInt32 fExhausted;
+};
+
+#endif
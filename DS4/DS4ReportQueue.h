@@ -0,0 +1,77 @@
+//
+//  DS4ReportQueue.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4ReportQueue_h
+#define DS4_DS4ReportQueue_h
+
+#include <stdint.h>
+#include <string.h>
+
+#define kDS4ReportQueueCapacity		32		//	Power of two, more than the report buffers
+
+struct DS4QueuedReport {
+	uint64_t	arrival;		//	Completion time, host clock
+	uint16_t	length;
+	uint8_t		buffer;			//	DS4ReportPool index
+};
+
+// Completed interrupt reads waiting for the work loop. USB completions push
+// and the work loop drains, one of each, without a lock. A wakeup is only
+// asked for when the first report of a batch arrives; everything that comes
+// in before the work loop gets to it rides along, so a burst of reports, or a
+// coalescing window, costs one context switch rather than one per report.
+struct DS4ReportQueue {
+	DS4QueuedReport	reports[kDS4ReportQueueCapacity];
+	uint32_t		head;		//	Next slot to push, written by the producer
+	uint32_t		tail;		//	Next slot to pop, written by the consumer
+	uint32_t		pending;	//	A wakeup has been asked for and not yet started draining
+
+	void reset(void)
+	{
+		memset(this, 0, sizeof(*this));
+	}
+
+	// Returns false when the queue is full. Otherwise *wake says whether the
+	// caller has to schedule a drain.
+	bool push(uint8_t buffer, uint16_t length, uint64_t arrival, bool *wake)
+	{
+		uint32_t h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+		if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= kDS4ReportQueueCapacity)
+			return false;
+
+		DS4QueuedReport *report = &reports[h & (kDS4ReportQueueCapacity - 1)];
+		report->arrival = arrival;
+		report->length = length;
+		report->buffer = buffer;
+		__atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+
+		*wake = __atomic_exchange_n(&pending, 1, __ATOMIC_ACQ_REL) == 0;
+		return true;
+	}
+
+	// Called when a drain starts, before the first pop. Reports pushed from
+	// here on either get popped by this drain or ask for a new one. The
+	// exchange, rather than a store, is what makes pushes that saw the flag
+	// still set visible to the pops that follow.
+	void beginDrain(void)
+	{
+		__atomic_exchange_n(&pending, 0, __ATOMIC_ACQ_REL);
+	}
+
+	bool pop(DS4QueuedReport *out)
+	{
+		uint32_t t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+		if (t == __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+			return false;
+
+		*out = reports[t & (kDS4ReportQueueCapacity - 1)];
+		__atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,186 @@
+//
+//  DS4Resampler.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4Resampler_h
+#define DS4_DS4Resampler_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "DS4Report.h"
+
+#define kDS4ResampleHistory		4		//	Power of two
+#define kDS4ResampleButtonMask	0x3FFF	//	Button 1-14
+
+struct DS4ResampleReport {
+	uint64_t	time;
+	uint8_t		bytes[DS4TransportTraits<kDS4TransportBluetooth>::kReportLength];
+};
+
+// Turns reports arriving on the pad's clock into exactly one report per
+// frame of a client's display clock, frames falling at phase + n * period.
+//
+// Sticks, triggers and motion axes are interpolated between the two reports
+// either side of frameTime - delay; with delay at least one report period
+// there is always a report after that point, so nothing is extrapolated and
+// every frame sees the input at the same age. Buttons and the hat come from
+// the newest report but are latched, so a press and release that both fall
+// between two frames still shows as pressed for one frame, and a release and
+// press shows as released for one. A hat direction tapped between frames is
+// kept the same way. Everything else, touch and status included, is the
+// newest report's.
+//
+// Times are in whatever clock the caller uses, consistently. Not thread safe.
+struct DS4FrameResampler {
+	DS4ResampleReport	history[kDS4ResampleHistory];
+	uint32_t			count;			//	Reports seen, the newest at (count - 1)
+	uint16_t			length;
+	uint8_t				payload;
+	bool				crc;
+	uint64_t			period;
+	uint64_t			phase;
+	uint64_t			delay;
+
+	uint32_t			downSince;		//	Buttons seen down since the last frame
+	uint32_t			upSince;		//	Buttons seen up since the last frame
+	uint32_t			lastButtons;	//	As delivered in the last frame
+	uint8_t				hatSince;		//	Last direction seen since the last frame
+	uint8_t				lastHat;
+
+	void reset(DS4Transport transport, uint64_t framePeriod, uint64_t framePhase, uint64_t sampleDelay)
+	{
+		memset(this, 0, sizeof(*this));
+		if (transport == kDS4TransportUSB) {
+			length = DS4TransportTraits<kDS4TransportUSB>::kReportLength;
+			payload = DS4TransportTraits<kDS4TransportUSB>::kPayload;
+		} else {
+			length = DS4TransportTraits<kDS4TransportBluetooth>::kReportLength;
+			payload = DS4TransportTraits<kDS4TransportBluetooth>::kPayload;
+			crc = true;
+		}
+		period = framePeriod;
+		phase = framePhase;
+		delay = sampleDelay;
+		hatSince = kDS4HatReleased;
+		lastHat = kDS4HatReleased;
+	}
+
+	// Takes a decoded input report. Reports must arrive in time order.
+	void push(const uint8_t *report, size_t reportLength, uint64_t time)
+	{
+		if (reportLength < length)
+			return;
+
+		DS4ResampleReport *slot = &history[count++ & (kDS4ResampleHistory - 1)];
+		slot->time = time;
+		memcpy(slot->bytes, report, length);
+
+		uint8_t hat;
+		uint32_t buttons = readButtons(slot->bytes, &hat);
+		downSince |= buttons;
+		upSince |= ~buttons & kDS4ResampleButtonMask;
+		if (hat != kDS4HatReleased)
+			hatSince = hat;
+	}
+
+	// The first frame boundary after now.
+	uint64_t nextFrame(uint64_t now) const
+	{
+		if (period == 0)
+			return now;
+		if (now < phase)
+			return phase - ((phase - now - 1) / period) * period;
+		return phase + ((now - phase) / period + 1) * period;
+	}
+
+	// Writes the report for the frame at frameTime into out, which holds a
+	// full report. Returns false until a report has been pushed.
+	bool frame(uint64_t frameTime, uint8_t *out)
+	{
+		if (count == 0)
+			return false;
+
+		const DS4ResampleReport *newest = &history[(count - 1) & (kDS4ResampleHistory - 1)];
+		const DS4ResampleReport *before = newest, *after = newest;
+		uint64_t sample = (frameTime > delay) ? frameTime - delay : 0;
+		uint32_t held = (count < kDS4ResampleHistory) ? count : kDS4ResampleHistory;
+
+		// Newest report at or before the sample point, and the one after it.
+		for (uint32_t i = 1; i < held && before->time > sample; i++) {
+			after = before;
+			before = &history[(count - 1 - i) & (kDS4ResampleHistory - 1)];
+		}
+
+		uint32_t weight = 0;
+		if (before != after && sample > before->time) {
+			weight = 256;
+			if (sample < after->time)
+				weight = (uint32_t)(((sample - before->time) * 256) / (after->time - before->time));
+		}
+
+		memcpy(out, newest->bytes, length);
+
+		uint8_t *p = out + payload;
+		const uint8_t *a = before->bytes + payload, *b = after->bytes + payload;
+		for (int i = 0; i < 4; i++)
+			p[kDS4OffsetLeftX + i] = mix8(a[kDS4OffsetLeftX + i], b[kDS4OffsetLeftX + i], weight);
+		p[kDS4OffsetL2] = mix8(a[kDS4OffsetL2], b[kDS4OffsetL2], weight);
+		p[kDS4OffsetR2] = mix8(a[kDS4OffsetR2], b[kDS4OffsetR2], weight);
+		for (int i = 0; i < 3; i++) {
+			mix16(a + kDS4OffsetGyro + i * 2, b + kDS4OffsetGyro + i * 2, weight, p + kDS4OffsetGyro + i * 2);
+			mix16(a + kDS4OffsetAccel + i * 2, b + kDS4OffsetAccel + i * 2, weight, p + kDS4OffsetAccel + i * 2);
+		}
+
+		uint8_t hat;
+		uint32_t buttons = readButtons(newest->bytes, &hat);
+		buttons = (buttons | downSince) & ~(lastButtons & upSince);
+		if (hat == kDS4HatReleased && lastHat == kDS4HatReleased)
+			hat = hatSince;
+
+		p[kDS4OffsetButtons] = (uint8_t)((hat & 0x0F) | ((buttons & 0x0F) << 4));
+		p[kDS4OffsetButtons + 1] = (uint8_t)(buttons >> 4);
+		p[kDS4OffsetButtons + 2] = (uint8_t)((p[kDS4OffsetButtons + 2] & 0xFC) | ((buttons >> 12) & 0x03));
+
+		if (crc) {
+			uint32_t sum = DS4CRC32(kDS4CRC32SeedInput, out, length - 4);
+			for (int i = 0; i < 4; i++)
+				out[length - 4 + i] = (uint8_t)(sum >> (8 * i));
+		}
+
+		lastButtons = buttons;
+		lastHat = hat;
+		downSince = 0;
+		upSince = 0;
+		hatSince = kDS4HatReleased;
+		return true;
+	}
+
+private:
+	uint32_t readButtons(const uint8_t *report, uint8_t *hat) const
+	{
+		const uint8_t *p = report + payload;
+		*hat = p[kDS4OffsetButtons] & 0x0F;
+		return (uint32_t)((p[kDS4OffsetButtons] >> 4) | (p[kDS4OffsetButtons + 1] << 4) |
+						  ((p[kDS4OffsetButtons + 2] & 0x03) << 12));
+	}
+
+	static uint8_t mix8(uint8_t a, uint8_t b, uint32_t weight)
+	{
+		return (uint8_t)((a * (256 - weight) + b * weight + 128) >> 8);
+	}
+
+	static void mix16(const uint8_t *a, const uint8_t *b, uint32_t weight, uint8_t *out)
+	{
+		int32_t from = (int16_t)DS4ReadLE16(a), to = (int16_t)DS4ReadLE16(b);
+		int32_t value = from + ((to - from) * (int32_t)weight) / 256;
+		out[0] = (uint8_t)value;
+		out[1] = (uint8_t)(value >> 8);
+	}
+};
+
+#endif
@@ -8,7 +8,9 @@
 
 
 #include <IOKit/IOLib.h>
+#include <IOKit/IOUserClient.h>
 #include "DS4Service.h"
+#include "DS4.h"
 
 // This required macro defines the class's constructors, destructors,
 // and several other methods I/O Kit requires.
@@ -21,12 +23,27 @@ bool DS4Service::init(OSDictionary *dict)
 {
 	bool result = super::init(dict);
 	IOLog("Service Initializing\n");
+	
+	fLock = IOLockAlloc();
+	if (fLock == NULL)
+		return false;
+	
+	bzero(fIdentities, sizeof(fIdentities));
+	bzero(fIdentityUsed, sizeof(fIdentityUsed));
+	fIdentityClock = 0;
+	
 	return result;
 }
 
 void DS4Service::free(void)
 {
 	IOLog("Service Freeing\n");
+	
+	if (fLock != NULL) {
+		IOLockFree(fLock);
+		fLock = NULL;
+	}
+	
 	super::free();
 }
 
@@ -42,6 +59,11 @@ bool DS4Service::start(IOService *provider)
 {
 	bool result = super::start(provider);
 	IOLog("Service Starting\n");
+	
+	// Let pads find us with waitForMatchingService.
+	if (result)
+		registerService();
+	
 	return result;
 }
 
@@ -50,3 +72,94 @@ void DS4Service::stop(IOService *provider)
 	IOLog("Service Stopping\n");
 	super::stop(provider);
 }
+
+// DS4Pair here pairs every attached USB pad at once, the bulk counterpart of
+// setting it on a single pad. Each pad runs its own transfers, so they all
+// proceed in parallel; DS4PairingStarted says how many took the request and
+// each pad's DS4PairingStatus says how it went.
+IOReturn DS4Service::setProperties(OSObject *properties)
+{
+	OSDictionary *dict = OSDynamicCast(OSDictionary, properties);
+	if (dict == NULL)
+		return kIOReturnBadArgument;
+	
+	OSDictionary *pair = OSDynamicCast(OSDictionary, dict->getObject(kDS4PairKey));
+	if (pair == NULL)
+		return kIOReturnUnsupported;
+	
+	// A new host and link key hands the pads to another machine.
+	if (IOUserClient::clientHasPrivilege(current_task(), kIOClientPrivilegeAdministrator) != kIOReturnSuccess)
+		return kIOReturnNotPrivileged;
+	
+	OSDictionary *matching = serviceMatching("SonyPlaystationDualShock4");
+	if (matching == NULL)
+		return kIOReturnNoMemory;
+	
+	OSIterator *pads = getMatchingServices(matching);
+	matching->release();
+	if (pads == NULL)
+		return kIOReturnNotFound;
+	
+	// A malformed request is the same for every pad, so the first refusal ends it.
+	UInt32 started = 0, attempted = 0;
+	IOReturn result = kIOReturnSuccess;
+	while (OSObject *object = pads->getNextObject()) {
+		SonyPlaystationDualShock4 *pad = OSDynamicCast(SonyPlaystationDualShock4, object);
+		if (pad == NULL)
+			continue;
+		
+		attempted++;
+		result = pad->startPairing(pair);
+		if (result == kIOReturnBadArgument)
+			break;
+		if (result == kIOReturnSuccess)
+			started++;
+	}
+	pads->release();
+	
+	if (result == kIOReturnBadArgument)
+		return result;
+	
+	IOLog("DS4 Pairing %u of %u pads\n", (unsigned)started, (unsigned)attempted);
+	setProperty("DS4PairingStarted", started, 32);
+	
+	return kIOReturnSuccess;
+}
+
+bool DS4Service::copyIdentity(const UInt8 mac[6], DS4DeviceIdentity *identity)
+{
+	bool found = false;
+	
+	IOLockLock(fLock);
+	for (int i = 0; i < kDS4IdentityCacheSize; i++) {
+		if (fIdentityUsed[i] != 0 && memcmp(fIdentities[i].mac, mac, 6) == 0) {
+			*identity = fIdentities[i];
+			fIdentityUsed[i] = ++fIdentityClock;
+			found = true;
+			break;
+		}
+	}
+	IOLockUnlock(fLock);
+	
+	return found;
+}
+
+// Replaces the entry for the same pad, or else the least recently used one.
+void DS4Service::storeIdentity(const DS4DeviceIdentity *identity)
+{
+	int slot = 0;
+	
+	IOLockLock(fLock);
+	for (int i = 0; i < kDS4IdentityCacheSize; i++) {
+		if (fIdentityUsed[i] != 0 && memcmp(fIdentities[i].mac, identity->mac, 6) == 0) {
+			slot = i;
+			break;
+		}
+		if (fIdentityUsed[i] < fIdentityUsed[slot])
+			slot = i;
+	}
+	
+	fIdentities[slot] = *identity;
+	fIdentityUsed[slot] = ++fIdentityClock;
+	IOLockUnlock(fLock);
+}
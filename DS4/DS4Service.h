@@ -6,7 +6,16 @@
 //  Copyright (c) 2015 Little Black Hat. All rights reserved.
 //
 
+#ifndef DS4_DS4Service_h
+#define DS4_DS4Service_h
+
 #include <IOKit/IOService.h>
+#include <IOKit/IOLib.h>
+
+#include "DS4Identity.h"
+
+#define kDS4IdentityCacheSize	32
+
 class DS4Service : public IOService
 {
 	OSDeclareDefaultStructors(DS4Service)
@@ -16,4 +25,18 @@ public:
 	virtual IOService *probe(IOService *provider, SInt32 *score);
 	virtual bool start(IOService *provider);
 	virtual void stop(IOService *provider);
-};
\ No newline at end of file
+	virtual IOReturn setProperties(OSObject *properties);
+	
+	// Identities of every pad seen since the driver loaded, keyed by pad MAC,
+	// so a pad that reconnects does not have to be queried again.
+	bool copyIdentity(const UInt8 mac[6], DS4DeviceIdentity *identity);
+	void storeIdentity(const DS4DeviceIdentity *identity);
+	
+private:
+	IOLock *fLock;
+	DS4DeviceIdentity fIdentities[kDS4IdentityCacheSize];
+	UInt64 fIdentityUsed[kDS4IdentityCacheSize];
+	UInt64 fIdentityClock;
+};
+
+#endif
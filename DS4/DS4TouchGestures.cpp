@@ -0,0 +1,235 @@
+//
+//  DS4TouchGestures.cpp
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#include <string.h>
+
+#include "DS4TouchGestures.h"
+
+#define kNanosecondsPerMS	1000000ULL
+
+#define kGestureButtons		(kDS4VirtualTap | kDS4VirtualDoubleTap | \
+							 kDS4VirtualSwipeLeft | kDS4VirtualSwipeRight | \
+							 kDS4VirtualSwipeUp | kDS4VirtualSwipeDown | \
+							 kDS4VirtualClick | kDS4VirtualSecondaryClick)
+
+const DS4TouchGestureConfig DS4DefaultTouchGestureConfig = {
+	180 * kNanosecondsPerMS,	//	tapMaxTime
+	300 * kNanosecondsPerMS,	//	doubleTapWindow
+	400 * kNanosecondsPerMS,	//	swipeMaxTime
+	50 * kNanosecondsPerMS,		//	pulseTime
+	40,							//	tapMaxTravel
+	150,						//	doubleTapMaxDistance
+	120,						//	edgeMargin
+	500,						//	swipeMinTravel
+	24,							//	scrollStart
+	48,							//	pinchStart
+	243,						//	inertiaDecay, ~0.95 per report
+	64							//	inertiaStop, a quarter unit per report
+};
+
+static inline int32_t Abs(int32_t value)
+{
+	return value < 0 ? -value : value;
+}
+
+// Octagonal approximation of the euclidean distance, within about 8%.
+static inline int32_t Distance(int32_t dx, int32_t dy)
+{
+	int32_t a = Abs(dx), b = Abs(dy);
+	return a > b ? a + b / 2 : b + a / 2;
+}
+
+static inline int16_t ClampAxis(int32_t value)
+{
+	return (int16_t)(value > 32767 ? 32767 : value < -32768 ? -32768 : value);
+}
+
+void DS4TouchGestures::reset(const DS4TouchGestureConfig *config)
+{
+	memset(this, 0, sizeof(*this));
+	fConfig = *config;
+	fMode = kModeIdle;
+}
+
+void DS4TouchGestures::process(DS4State *state, uint64_t now)
+{
+	const DS4Touch *active[kDS4TouchCount];
+	int count = 0;
+
+	for (int i = 0; i < kDS4TouchCount; i++) {
+		if (state->touch[i].active)
+			active[count++] = &state->touch[i];
+	}
+
+	state->virtualButtons &= ~kGestureButtons;
+	state->virtualAxes[kDS4AxisScrollX] = 0;
+	state->virtualAxes[kDS4AxisScrollY] = 0;
+	state->virtualAxes[kDS4AxisZoom] = 0;
+
+	// A new tracking id on the only finger means it lifted and touched again
+	// between two reports.
+	if (fMode == kModeOneFinger && count == 1 && active[0]->id != fIDs[0])
+		endContact(now);
+
+	if (count == 0) {
+		if (fMode == kModeInertia) {
+			state->virtualAxes[kDS4AxisScrollX] = ClampAxis(fVelocityX / 256);
+			state->virtualAxes[kDS4AxisScrollY] = ClampAxis(fVelocityY / 256);
+			fVelocityX = fVelocityX * fConfig.inertiaDecay / 256;
+			fVelocityY = fVelocityY * fConfig.inertiaDecay / 256;
+			if (Abs(fVelocityX) < fConfig.inertiaStop && Abs(fVelocityY) < fConfig.inertiaStop)
+				fMode = kModeIdle;
+		} else if (fMode != kModeIdle) {
+			endContact(now);
+		}
+	} else if (count == 1) {
+		if (fMode == kModeIdle || fMode == kModeInertia)
+			beginContact(active[0], now);
+		else if (fMode == kModeOneFinger)
+			trackOneFinger(active[0], now);
+		// Once two fingers have been down, nothing is tracked until all lift.
+	} else {
+		if (fMode == kModeIdle || fMode == kModeInertia)
+			beginContact(active[0], now);
+
+		if (fMode == kModeOneFinger || active[0]->id != fIDs[0] || active[1]->id != fIDs[1]) {
+			// Start, or restart after a finger change, from a fresh baseline.
+			if (fMode == kModeOneFinger) {
+				fMode = kModeTwoFingers;
+				fPendingX = fPendingY = fPendingSpread = 0;
+			}
+			fMaxFingers = 2;
+			fIDs[0] = active[0]->id;
+			fIDs[1] = active[1]->id;
+			fCentroidX = (active[0]->x + active[1]->x) / 2;
+			fCentroidY = (active[0]->y + active[1]->y) / 2;
+			fSpread = Distance(active[0]->x - active[1]->x, active[0]->y - active[1]->y);
+		} else {
+			trackTwoFingers(active[0], active[1], state);
+		}
+	}
+
+	if (state->buttons & kDS4ButtonTouchpad)
+		state->virtualButtons |= (count >= 2 || fMaxFingers >= 2) ? kDS4VirtualSecondaryClick : kDS4VirtualClick;
+
+	if (fPulsed != 0) {
+		if (now < fPulseEnd)
+			state->virtualButtons |= fPulsed;
+		else
+			fPulsed = 0;
+	}
+}
+
+void DS4TouchGestures::beginContact(const DS4Touch *touch, uint64_t now)
+{
+	fMode = kModeOneFinger;
+	fMaxFingers = 1;
+	fIDs[0] = touch->id;
+	fSwiped = false;
+	fStartX = touch->x;
+	fStartY = touch->y;
+	fStartTime = now;
+	fMaxTravel = 0;
+	fVelocityX = fVelocityY = 0;
+}
+
+void DS4TouchGestures::endContact(uint64_t now)
+{
+	if (fMode == kModeOneFinger && fMaxFingers == 1 && !fSwiped &&
+		now - fStartTime <= fConfig.tapMaxTime && fMaxTravel <= fConfig.tapMaxTravel) {
+		if (fLastTapTime != 0 && now - fLastTapTime <= fConfig.doubleTapWindow &&
+			Distance(fStartX - fLastTapX, fStartY - fLastTapY) <= fConfig.doubleTapMaxDistance) {
+			fPulsed &= ~kDS4VirtualTap;
+			pulse(kDS4VirtualDoubleTap, now);
+			fLastTapTime = 0;
+		} else {
+			pulse(kDS4VirtualTap, now);
+			fLastTapTime = now;
+			fLastTapX = fStartX;
+			fLastTapY = fStartY;
+		}
+	}
+
+	if (fMode == kModeScroll &&
+		(Abs(fVelocityX) >= fConfig.inertiaStop || Abs(fVelocityY) >= fConfig.inertiaStop))
+		fMode = kModeInertia;
+	else
+		fMode = kModeIdle;
+}
+
+void DS4TouchGestures::trackOneFinger(const DS4Touch *touch, uint64_t now)
+{
+	int32_t dx = touch->x - fStartX;
+	int32_t dy = touch->y - fStartY;
+	int32_t travel = Abs(dx) > Abs(dy) ? Abs(dx) : Abs(dy);
+
+	if (travel > fMaxTravel)
+		fMaxTravel = (uint16_t)travel;
+
+	if (fSwiped || now - fStartTime > fConfig.swipeMaxTime)
+		return;
+
+	// The pad is about half as tall as it is wide, so vertical swipes need half the travel.
+	uint32_t swipe = 0;
+	if (fStartX < fConfig.edgeMargin && dx >= fConfig.swipeMinTravel)
+		swipe = kDS4VirtualSwipeRight;
+	else if (fStartX > kDS4TouchMaxX - fConfig.edgeMargin && -dx >= fConfig.swipeMinTravel)
+		swipe = kDS4VirtualSwipeLeft;
+	else if (fStartY < fConfig.edgeMargin && dy >= fConfig.swipeMinTravel / 2)
+		swipe = kDS4VirtualSwipeDown;
+	else if (fStartY > kDS4TouchMaxY - fConfig.edgeMargin && -dy >= fConfig.swipeMinTravel / 2)
+		swipe = kDS4VirtualSwipeUp;
+
+	if (swipe != 0) {
+		pulse(swipe, now);
+		fSwiped = true;
+	}
+}
+
+void DS4TouchGestures::trackTwoFingers(const DS4Touch *a, const DS4Touch *b, DS4State *state)
+{
+	int32_t centroidX = (a->x + b->x) / 2;
+	int32_t centroidY = (a->y + b->y) / 2;
+	int32_t spread = Distance(a->x - b->x, a->y - b->y);
+	int32_t dx = centroidX - fCentroidX;
+	int32_t dy = centroidY - fCentroidY;
+	int32_t ds = spread - fSpread;
+
+	fCentroidX = centroidX;
+	fCentroidY = centroidY;
+	fSpread = spread;
+
+	switch (fMode) {
+		case kModeTwoFingers:
+			fPendingX += dx;
+			fPendingY += dy;
+			fPendingSpread += ds;
+			if (Abs(fPendingSpread) >= fConfig.pinchStart)
+				fMode = kModePinch;
+			else if (Abs(fPendingX) >= fConfig.scrollStart || Abs(fPendingY) >= fConfig.scrollStart)
+				fMode = kModeScroll;
+			break;
+
+		case kModeScroll:
+			state->virtualAxes[kDS4AxisScrollX] = ClampAxis(dx);
+			state->virtualAxes[kDS4AxisScrollY] = ClampAxis(dy);
+			// Smoothed so a jittery last frame does not decide the fling.
+			fVelocityX = (fVelocityX * 3 + dx * 256) / 4;
+			fVelocityY = (fVelocityY * 3 + dy * 256) / 4;
+			break;
+
+		case kModePinch:
+			state->virtualAxes[kDS4AxisZoom] = ClampAxis(ds);
+			break;
+	}
+}
+
+void DS4TouchGestures::pulse(uint32_t buttons, uint64_t now)
+{
+	fPulsed |= buttons;
+	fPulseEnd = now + fConfig.pulseTime;
+}
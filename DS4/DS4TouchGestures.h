@@ -0,0 +1,87 @@
+//
+//  DS4TouchGestures.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4TouchGestures_h
+#define DS4_DS4TouchGestures_h
+
+#include <stdint.h>
+
+#include "DS4Report.h"
+
+// Thresholds in touchpad units (1920 x 943) and nanoseconds of host time.
+struct DS4TouchGestureConfig {
+	uint64_t	tapMaxTime;
+	uint64_t	doubleTapWindow;
+	uint64_t	swipeMaxTime;
+	uint64_t	pulseTime;			//	How long momentary gestures stay pressed
+	uint16_t	tapMaxTravel;
+	uint16_t	doubleTapMaxDistance;
+	uint16_t	edgeMargin;
+	uint16_t	swipeMinTravel;
+	uint16_t	scrollStart;		//	Centroid travel before two fingers count as a scroll
+	uint16_t	pinchStart;			//	Spread change before two fingers count as a pinch
+	uint16_t	inertiaDecay;		//	Scroll velocity kept per report, out of 256
+	uint16_t	inertiaStop;		//	Velocity below which inertia ends, touch units / 256
+};
+
+extern const DS4TouchGestureConfig DS4DefaultTouchGestureConfig;
+
+// Incremental recognizer for taps, double taps, edge swipes, two finger
+// scroll (with inertia after lift-off), pinch and touchpad clicks. Each call
+// looks only at the newest report and a few values carried over from earlier
+// ones, and writes its results into the state's virtual buttons and axes.
+class DS4TouchGestures
+{
+public:
+	void reset(const DS4TouchGestureConfig *config = &DS4DefaultTouchGestureConfig);
+	void process(DS4State *state, uint64_t now);
+
+private:
+	enum Mode {
+		kModeIdle,
+		kModeOneFinger,
+		kModeTwoFingers,		//	Not yet decided between scroll and pinch
+		kModeScroll,
+		kModePinch,
+		kModeInertia
+	};
+
+	void beginContact(const DS4Touch *touch, uint64_t now);
+	void endContact(uint64_t now);
+	void trackOneFinger(const DS4Touch *touch, uint64_t now);
+	void trackTwoFingers(const DS4Touch *a, const DS4Touch *b, DS4State *state);
+	void pulse(uint32_t buttons, uint64_t now);
+
+	DS4TouchGestureConfig fConfig;
+	uint8_t		fMode;
+	uint8_t		fMaxFingers;		//	Most fingers seen during the current contact
+	uint8_t		fIDs[kDS4TouchCount];
+	bool		fSwiped;
+
+	uint16_t	fStartX;
+	uint16_t	fStartY;
+	uint64_t	fStartTime;
+	uint16_t	fMaxTravel;
+
+	int32_t		fCentroidX;
+	int32_t		fCentroidY;
+	int32_t		fSpread;
+	int32_t		fPendingX;			//	Two finger travel not yet assigned to a mode
+	int32_t		fPendingY;
+	int32_t		fPendingSpread;
+	int32_t		fVelocityX;			//	Scroll velocity, touch units / 256 per report
+	int32_t		fVelocityY;
+
+	uint64_t	fLastTapTime;
+	uint16_t	fLastTapX;
+	uint16_t	fLastTapY;
+
+	uint32_t	fPulsed;
+	uint64_t	fPulseEnd;
+};
+
+#endif
@@ -0,0 +1,107 @@
+//
+//  DS4TouchZones.cpp
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#include <string.h>
+
+#include "DS4TouchZones.h"
+
+#define kWidth		(kDS4TouchMaxX + 1)
+#define kHeight		(kDS4TouchMaxY + 1)
+
+const char * const DS4TouchZonePresetNames[kDS4TouchZonePresetCount] = {
+	"none",
+	"halves",
+	"grid3x3"
+};
+
+bool DS4TouchZones::configure(const DS4TouchZone *zones, unsigned count, bool requireClick)
+{
+	if (count > kDS4MaxTouchZones)
+		return false;
+
+	// Each cell belongs to the zone containing its centre.
+	for (unsigned row = 0; row < kDS4ZoneGridRows; row++) {
+		unsigned y = (2 * row + 1) * kHeight / (2 * kDS4ZoneGridRows);
+
+		for (unsigned column = 0; column < kDS4ZoneGridColumns; column++) {
+			unsigned x = (2 * column + 1) * kWidth / (2 * kDS4ZoneGridColumns);
+			uint8_t zone = kDS4ZoneNone;
+
+			for (unsigned i = 0; i < count; i++) {
+				if (x >= zones[i].left && x < zones[i].right && y >= zones[i].top && y < zones[i].bottom) {
+					zone = (uint8_t)i;
+					break;
+				}
+			}
+			fGrid[row][column] = zone;
+		}
+	}
+
+	fCount = (uint8_t)count;
+	fRequireClick = requireClick;
+	return true;
+}
+
+bool DS4TouchZones::configure(DS4TouchZonePreset preset, bool requireClick)
+{
+	DS4TouchZone zones[9];
+	unsigned count = 0;
+
+	switch (preset) {
+		case kDS4TouchZonesNone:
+			break;
+
+		case kDS4TouchZonesHalves:
+			zones[0] = (DS4TouchZone){ 0, 0, kWidth / 2, kHeight };
+			zones[1] = (DS4TouchZone){ kWidth / 2, 0, kWidth, kHeight };
+			count = 2;
+			break;
+
+		case kDS4TouchZonesGrid3x3:
+			for (unsigned row = 0; row < 3; row++) {
+				for (unsigned column = 0; column < 3; column++) {
+					zones[count++] = (DS4TouchZone){
+						(uint16_t)(column * kWidth / 3), (uint16_t)(row * kHeight / 3),
+						(uint16_t)((column + 1) * kWidth / 3), (uint16_t)((row + 1) * kHeight / 3)
+					};
+				}
+			}
+			break;
+
+		default:
+			return false;
+	}
+
+	return configure(zones, count, requireClick);
+}
+
+void DS4TouchZones::process(DS4State *state) const
+{
+	uint32_t pressed = 0;
+
+	if (fCount != 0 && (!fRequireClick || (state->buttons & kDS4ButtonTouchpad))) {
+		for (int i = 0; i < kDS4TouchCount; i++) {
+			const DS4Touch *touch = &state->touch[i];
+			if (!touch->active)
+				continue;
+
+			// Coordinates are 12 bit, so clamp anything past the documented range.
+			unsigned column = touch->x * kDS4ZoneGridColumns / kWidth;
+			unsigned row = touch->y * kDS4ZoneGridRows / kHeight;
+			if (column >= kDS4ZoneGridColumns)
+				column = kDS4ZoneGridColumns - 1;
+			if (row >= kDS4ZoneGridRows)
+				row = kDS4ZoneGridRows - 1;
+
+			uint8_t zone = fGrid[row][column];
+			if (zone != kDS4ZoneNone)
+				pressed |= 1U << (kDS4VirtualZoneShift + zone);
+		}
+	}
+
+	state->virtualButtons = (state->virtualButtons & ~kDS4VirtualZoneMask) | pressed;
+}
@@ -0,0 +1,58 @@
+//
+//  DS4TouchZones.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4TouchZones_h
+#define DS4_DS4TouchZones_h
+
+#include <stdint.h>
+
+#include "DS4Report.h"
+
+#define kDS4MaxTouchZones		16
+#define kDS4ZoneGridColumns		64		//	30 touch units per cell
+#define kDS4ZoneGridRows		32		//	About 29.5 touch units per cell
+#define kDS4ZoneNone			0xFF
+
+enum DS4TouchZonePreset {
+	kDS4TouchZonesNone,
+	kDS4TouchZonesHalves,		//	Left, right
+	kDS4TouchZonesGrid3x3,		//	Row by row from the top left
+	kDS4TouchZonePresetCount
+};
+
+extern const char * const DS4TouchZonePresetNames[kDS4TouchZonePresetCount];
+
+// A rectangle in touchpad units, right and bottom exclusive.
+struct DS4TouchZone {
+	uint16_t	left;
+	uint16_t	top;
+	uint16_t	right;
+	uint16_t	bottom;
+};
+
+// Splits the touchpad into up to 16 zones that act as virtual buttons. The
+// zones are rasterized once into a coarse grid, so finding a finger's zone
+// is a single lookup however many zones there are. Where zones overlap the
+// first one listed wins.
+class DS4TouchZones
+{
+public:
+	// With requireClick a zone is only pressed while the touchpad is clicked
+	// with a finger in it; otherwise touching it is enough.
+	bool configure(const DS4TouchZone *zones, unsigned count, bool requireClick);
+	bool configure(DS4TouchZonePreset preset, bool requireClick);
+
+	void process(DS4State *state) const;
+	unsigned count(void) const { return fCount; }
+
+private:
+	uint8_t		fGrid[kDS4ZoneGridRows][kDS4ZoneGridColumns];
+	uint8_t		fCount;
+	bool		fRequireClick;
+};
+
+#endif
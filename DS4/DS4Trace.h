@@ -0,0 +1,126 @@
+//
+//  DS4Trace.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4Trace_h
+#define DS4_DS4Trace_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+enum DS4TraceStage {
+	kDS4TraceArrival,			//	Instant, report handed to the driver
+	kDS4TraceDecode,
+	kDS4TraceFilter,
+	kDS4TraceDispatch,			//	Report delivered to the HID stack
+	kDS4TraceOutputSubmit,
+	kDS4TraceOutputComplete,
+	kDS4TraceStageCount
+};
+
+struct DS4TraceEvent {
+	uint64_t	begin;			//	Host clock, ns once exported
+	uint32_t	duration;		//	Same unit as begin, 0 for instant events
+	uint16_t	sequence;		//	Report counter the span belongs to
+	uint8_t		stage;
+	uint8_t		reserved;
+};
+
+#define kDS4TraceCapacity		4096	//	Events per pad, power of two
+
+// Ring of the most recent trace events for one pad. Writers reserve a slot
+// with a single atomic add and publish it through the slot's ticket, so the
+// input path and USB completions can both record without a lock, and a
+// reader can take a snapshot without stopping either. Older events are
+// overwritten.
+struct DS4TraceBuffer {
+	DS4TraceEvent	events[kDS4TraceCapacity];
+	uint32_t		tickets[kDS4TraceCapacity];	//	Reservation + 1 of the event in the slot, 0 while being written
+	uint32_t		head;
+
+	void reset(void)
+	{
+		memset(this, 0, sizeof(*this));
+	}
+
+	void record(DS4TraceStage stage, uint64_t begin, uint64_t end, uint16_t sequence)
+	{
+		uint32_t ticket = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+		uint32_t slot = ticket & (kDS4TraceCapacity - 1);
+		DS4TraceEvent *event = &events[slot];
+
+		__atomic_store_n(&tickets[slot], 0, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		event->begin = begin;
+		event->duration = (uint32_t)(end - begin);
+		event->sequence = sequence;
+		event->stage = (uint8_t)stage;
+		__atomic_store_n(&tickets[slot], ticket + 1, __ATOMIC_RELEASE);
+	}
+
+	// Copies out up to max events, oldest first. Slots a writer is in the
+	// middle of replacing are skipped rather than waited on.
+	size_t snapshot(DS4TraceEvent *out, size_t max) const
+	{
+		uint32_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+		uint32_t count = end < kDS4TraceCapacity ? end : kDS4TraceCapacity;
+		size_t copied = 0;
+
+		if (count > max)
+			count = (uint32_t)max;
+
+		for (uint32_t ticket = end - count; ticket != end; ticket++) {
+			uint32_t slot = ticket & (kDS4TraceCapacity - 1);
+			if (__atomic_load_n(&tickets[slot], __ATOMIC_ACQUIRE) != ticket + 1)
+				continue;
+
+			out[copied] = events[slot];
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&tickets[slot], __ATOMIC_RELAXED) == ticket + 1)
+				copied++;
+		}
+
+		return copied;
+	}
+};
+
+// Export format read by tools/ds4trace:
+//
+//	header:	'D' 'S' '4' 'T', version (u16), pad (u16), count (u32)
+//	event:	begin ns (u64), duration ns (u32), sequence (u16), stage (u8), reserved (u8)
+
+#define kDS4TraceExportVersion		1
+#define kDS4TraceExportHeaderLength	12
+#define kDS4TraceExportEventLength	16
+
+static inline void DS4TraceWriteExportHeader(uint8_t *out, uint16_t pad, uint32_t count)
+{
+	out[0] = 'D';
+	out[1] = 'S';
+	out[2] = '4';
+	out[3] = 'T';
+	out[4] = kDS4TraceExportVersion & 0xFF;
+	out[5] = kDS4TraceExportVersion >> 8;
+	out[6] = pad & 0xFF;
+	out[7] = pad >> 8;
+	for (int i = 0; i < 4; i++)
+		out[8 + i] = (uint8_t)(count >> (8 * i));
+}
+
+static inline void DS4TraceWriteExportEvent(uint8_t *out, const DS4TraceEvent *event)
+{
+	for (int i = 0; i < 8; i++)
+		out[i] = (uint8_t)(event->begin >> (8 * i));
+	for (int i = 0; i < 4; i++)
+		out[8 + i] = (uint8_t)(event->duration >> (8 * i));
+	out[12] = event->sequence & 0xFF;
+	out[13] = event->sequence >> 8;
+	out[14] = event->stage;
+	out[15] = 0;
+}
+
+#endif
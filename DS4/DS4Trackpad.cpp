@@ -0,0 +1,129 @@
+//
+//  DS4Trackpad.cpp
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#include <string.h>
+
+#include "DS4Trackpad.h"
+
+const DS4TrackpadConfig DS4DefaultTrackpadConfig = {
+	60,			//	edgeMargin
+	200,		//	maxJump
+	128,		//	baseGain, half a pointer unit per touch unit
+	512,		//	maxGain
+	4,			//	accelStart, about 1000 touch units a second at 250 Hz
+	40			//	accelFull
+};
+
+// Takes as many whole counts out of a remainder as one report can carry.
+static inline int8_t TakeWhole(int32_t *remainder)
+{
+	int32_t whole = *remainder / 256;
+	if (whole > 127)
+		whole = 127;
+	else if (whole < -127)
+		whole = -127;
+
+	*remainder -= whole * 256;
+	return (int8_t)whole;
+}
+
+static inline int32_t Abs(int32_t value)
+{
+	return value < 0 ? -value : value;
+}
+
+void DS4Trackpad::reset(const DS4TrackpadConfig *config)
+{
+	memset(this, 0, sizeof(*this));
+	fConfig = *config;
+
+	int32_t start = fConfig.accelStart, full = fConfig.accelFull;
+	for (int32_t speed = 0; speed < kDS4TrackpadCurveSize; speed++) {
+		if (speed <= start)
+			fGain[speed] = fConfig.baseGain;
+		else if (speed >= full)
+			fGain[speed] = fConfig.maxGain;
+		else
+			fGain[speed] = (uint16_t)(fConfig.baseGain +
+									  (fConfig.maxGain - fConfig.baseGain) * (speed - start) / (full - start));
+	}
+}
+
+bool DS4Trackpad::process(const DS4State *state, DS4PointerReport *pointer)
+{
+	const DS4Touch *touch = NULL;
+	int count = 0;
+
+	for (int i = 0; i < kDS4TouchCount; i++) {
+		if (state->touch[i].active) {
+			if (touch == NULL)
+				touch = &state->touch[i];
+			count++;
+		}
+	}
+
+	uint8_t buttons = 0;
+	if (state->buttons & kDS4ButtonTouchpad)
+		buttons |= count >= 2 ? kDS4PointerButtonRight : kDS4PointerButtonLeft;
+	if (state->virtualButtons & kDS4VirtualTap)
+		buttons |= kDS4PointerButtonLeft;
+
+	pointer->buttons = buttons;
+	pointer->dx = 0;
+	pointer->dy = 0;
+	bool moved = false;
+
+	// Two fingers are for scrolling and clicking, never for moving the pointer.
+	if (count != 1) {
+		fTracking = false;
+	} else if (!fTracking || touch->id != fID) {
+		fTracking = true;
+		fID = touch->id;
+		fRejected = touch->x < fConfig.edgeMargin || touch->x > kDS4TouchMaxX - fConfig.edgeMargin ||
+					touch->y < fConfig.edgeMargin || touch->y > kDS4TouchMaxY - fConfig.edgeMargin;
+		fLastX = touch->x;
+		fLastY = touch->y;
+
+		// The last contact's fractions go, anything it still owes does not.
+		fRemainderX -= fRemainderX % 256;
+		fRemainderY -= fRemainderY % 256;
+	} else {
+		int32_t dx = touch->x - fLastX;
+		int32_t dy = touch->y - fLastY;
+
+		fLastX = touch->x;
+		fLastY = touch->y;
+
+		// A jump this large is a palm landing or a missed lift, not motion.
+		if (!fRejected && Abs(dx) <= fConfig.maxJump && Abs(dy) <= fConfig.maxJump) {
+			pointer->dx = scale(dx, &fRemainderX);
+			pointer->dy = scale(dy, &fRemainderY);
+			moved = true;
+		}
+	}
+
+	// Motion past what one report carries keeps coming out after the finger
+	// slows or lifts.
+	if (!moved) {
+		pointer->dx = TakeWhole(&fRemainderX);
+		pointer->dy = TakeWhole(&fRemainderY);
+	}
+
+	bool changed = pointer->dx != 0 || pointer->dy != 0 || buttons != fButtons;
+	fButtons = buttons;
+	return changed;
+}
+
+int8_t DS4Trackpad::scale(int32_t delta, int32_t *remainder) const
+{
+	int32_t speed = Abs(delta);
+	if (speed >= kDS4TrackpadCurveSize)
+		speed = kDS4TrackpadCurveSize - 1;
+
+	*remainder += delta * fGain[speed];
+	return TakeWhole(remainder);
+}
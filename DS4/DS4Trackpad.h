@@ -0,0 +1,80 @@
+//
+//  DS4Trackpad.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4Trackpad_h
+#define DS4_DS4Trackpad_h
+
+#include <stdint.h>
+
+#include "DS4Report.h"
+
+#define kDS4PointerReportID			0x30
+#define kDS4PointerReportLength		4		//	ID, buttons, X, Y
+
+#define kDS4TrackpadCurveSize		64		//	Per report speeds covered by the gain table
+
+enum {
+	kDS4PointerButtonLeft		= 1 << 0,
+	kDS4PointerButtonRight		= 1 << 1
+};
+
+// Distances in touchpad units, gains in pointer units per touch unit * 256.
+struct DS4TrackpadConfig {
+	uint16_t	edgeMargin;			//	Contacts that land this close to an edge are ignored
+	uint16_t	maxJump;			//	Per report movement larger than this is dropped
+	uint16_t	baseGain;			//	Gain for slow movement
+	uint16_t	maxGain;			//	Gain at and above accelFull
+	uint16_t	accelStart;			//	Per report speed where acceleration begins
+	uint16_t	accelFull;			//	Per report speed where it reaches maxGain
+};
+
+extern const DS4TrackpadConfig DS4DefaultTrackpadConfig;
+
+struct DS4PointerReport {
+	uint8_t		buttons;
+	int8_t		dx;
+	int8_t		dy;
+};
+
+static inline void DS4WritePointerReport(const DS4PointerReport *pointer, uint8_t out[kDS4PointerReportLength])
+{
+	out[0] = kDS4PointerReportID;
+	out[1] = pointer->buttons;
+	out[2] = (uint8_t)pointer->dx;
+	out[3] = (uint8_t)pointer->dy;
+}
+
+// Turns one finger motion on the touchpad into relative pointer movement.
+// Speed is looked up in a gain table built once from the config, and the
+// fraction of a pointer unit left over after each report is carried into the
+// next one, so slow movement still adds up.
+class DS4Trackpad
+{
+public:
+	void reset(const DS4TrackpadConfig *config = &DS4DefaultTrackpadConfig);
+
+	// Returns true when the pointer report differs from an idle one or the
+	// buttons changed since the last report.
+	bool process(const DS4State *state, DS4PointerReport *pointer);
+
+private:
+	int8_t scale(int32_t delta, int32_t *remainder) const;
+
+	DS4TrackpadConfig fConfig;
+	uint16_t	fGain[kDS4TrackpadCurveSize];
+
+	bool		fTracking;
+	bool		fRejected;			//	Current contact started on an edge
+	uint8_t		fID;
+	uint8_t		fButtons;
+	uint16_t	fLastX;
+	uint16_t	fLastY;
+	int32_t		fRemainderX;		//	Not yet reported, 1/256 counts
+	int32_t		fRemainderY;
+};
+
+#endif
@@ -0,0 +1,79 @@
+//
+//  DS4Variants.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4Variants_h
+#define DS4_DS4Variants_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define kDS4SonyVendorID	0x054C
+
+// The kext only ever sees kDS4TransportUSB. Bluetooth framing is decoded and
+// built for the host tools, which replay captures taken on either link.
+enum DS4Transport {
+	kDS4TransportUSB,
+	kDS4TransportBluetooth,
+	kDS4TransportCount
+};
+
+enum DS4Variant {
+	kDS4VariantV1,			//	CUH-ZCT1, first generation pad
+	kDS4VariantV2,			//	CUH-ZCT2, light bar visible through the touchpad
+	kDS4VariantAdapter,		//	CUH-ZWA1 wireless adapter, relays a paired pad over USB
+	kDS4VariantCount
+};
+
+enum {
+	kDS4VariantFlagBluetooth	= 0x01,	//	Pad also has a Bluetooth link, which the kext does not drive
+	kDS4VariantFlagPadPresence	= 0x02	//	Device can be attached with no pad behind it
+};
+
+struct DS4VariantInfo {
+	uint16_t	vendorID;
+	uint16_t	productID;
+	uint8_t		variant;
+	uint8_t		flags;
+	uint16_t	reportRateHz;	//	Nominal input report rate on the USB interrupt pipe
+	const char	*name;
+};
+
+// Every variant accepts the same output report, framed per transport:
+// USB report 0x05 carries the payload at byte 1, Bluetooth report 0x11 at byte 3
+// followed by a CRC32 trailer.
+struct DS4OutputLayout {
+	uint8_t		reportID;
+	uint8_t		length;
+	uint8_t		payloadOffset;
+};
+
+static const DS4OutputLayout DS4OutputLayouts[kDS4TransportCount] = {
+	{ 0x05, 32, 1 },		//	kDS4TransportUSB
+	{ 0x11, 78, 3 }			//	kDS4TransportBluetooth
+};
+
+// Indexed by DS4Variant. Info.plist carries one IOKitPersonality per entry,
+// all matching the USB product ID, so the kext picks a variant's USB
+// decoder and output layout only.
+static const DS4VariantInfo DS4Variants[kDS4VariantCount] = {
+	{ kDS4SonyVendorID, 0x05C4, kDS4VariantV1,		kDS4VariantFlagBluetooth,	250,	"DualShock 4" },
+	{ kDS4SonyVendorID, 0x09CC, kDS4VariantV2,		kDS4VariantFlagBluetooth,	250,	"DualShock 4 (v2)" },
+	{ kDS4SonyVendorID, 0x0BA0, kDS4VariantAdapter,	kDS4VariantFlagPadPresence,	1000,	"DualShock 4 Wireless Adapter" }
+};
+
+// The table is a handful of entries, so this is a bounded scan run once from probe.
+static inline const DS4VariantInfo *DS4LookupVariant(uint16_t vendorID, uint16_t productID)
+{
+	for (size_t i = 0; i < kDS4VariantCount; i++) {
+		if (DS4Variants[i].vendorID == vendorID && DS4Variants[i].productID == productID)
+			return &DS4Variants[i];
+	}
+
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,134 @@
+//
+//  DS4Wear.h
+//  DS4
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4Wear_h
+#define DS4_DS4Wear_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "DS4Report.h"
+
+#define kDS4WearStickShift		3		//	256 positions per axis into 32 bins
+#define kDS4WearStickBins		(256 >> kDS4WearStickShift)
+#define kDS4WearTriggerShift	3
+#define kDS4WearTriggerBins		(256 >> kDS4WearTriggerShift)
+#define kDS4WearDurationBins	16		//	Bin 0 is under 2 ms, bin n 2^n to 2^(n+1) ms, the last anything longer
+#define kDS4WearKeyCount		18		//	The 14 buttons, then the hat as up, right, down, left
+
+enum DS4WearStick {
+	kDS4WearLeftStick,
+	kDS4WearRightStick,
+	kDS4WearStickCount
+};
+
+// Histograms of where the sticks and triggers sit and of how long each
+// button is held, for spotting worn pads. A drifting stick shows up as its
+// busiest bin, the rest position, moving away from the centre; a sticky
+// button as presses piling up in the long duration bins.
+//
+// Only the report path writes, so counts are bumped with a plain relaxed
+// load and store rather than a locked add. Readers see each count exactly,
+// though not all of them from the same report. Counts only ever go up.
+struct DS4WearHistograms {
+	uint64_t	samples;
+	uint32_t	sticks[kDS4WearStickCount][kDS4WearStickBins * kDS4WearStickBins];	//	Row Y, column X
+	uint32_t	triggers[2][kDS4WearTriggerBins];
+	uint32_t	presses[kDS4WearKeyCount][kDS4WearDurationBins];
+
+	uint32_t	held;								//	Keys down in the last report
+	uint64_t	pressed[kDS4WearKeyCount];			//	When each held key went down
+
+	void reset(void)
+	{
+		memset(this, 0, sizeof(*this));
+	}
+
+	void record(const DS4State *state, uint64_t now)
+	{
+		bump(&sticks[kDS4WearLeftStick][(state->leftY >> kDS4WearStickShift) * kDS4WearStickBins + (state->leftX >> kDS4WearStickShift)]);
+		bump(&sticks[kDS4WearRightStick][(state->rightY >> kDS4WearStickShift) * kDS4WearStickBins + (state->rightX >> kDS4WearStickShift)]);
+		bump(&triggers[0][state->l2 >> kDS4WearTriggerShift]);
+		bump(&triggers[1][state->r2 >> kDS4WearTriggerShift]);
+		__atomic_store_n(&samples, __atomic_load_n(&samples, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+
+		uint32_t keys = DS4WearKeys(state);
+		uint32_t changed = keys ^ held;
+		if (changed == 0)
+			return;
+
+		for (int key = 0; key < kDS4WearKeyCount; key++) {
+			if (!(changed & (1U << key)))
+				continue;
+			if (keys & (1U << key))
+				pressed[key] = now;
+			else
+				bump(&presses[key][DS4WearDurationBin(now - pressed[key])]);
+		}
+		held = keys;
+	}
+
+	uint32_t get(const uint32_t *count) const
+	{
+		return __atomic_load_n(count, __ATOMIC_RELAXED);
+	}
+
+	// The busiest bin of a stick, as an offset from the centre in stick
+	// units. A healthy pad rests within a bin of (0, 0).
+	void restOffset(DS4WearStick stick, int *dx, int *dy) const
+	{
+		unsigned best = 0;
+		uint32_t most = 0;
+
+		for (unsigned bin = 0; bin < kDS4WearStickBins * kDS4WearStickBins; bin++) {
+			uint32_t count = get(&sticks[stick][bin]);
+			if (count > most) {
+				most = count;
+				best = bin;
+			}
+		}
+
+		const int half = 1 << (kDS4WearStickShift - 1);
+		*dx = (int)((best % kDS4WearStickBins) << kDS4WearStickShift) + half - 128;
+		*dy = (int)((best / kDS4WearStickBins) << kDS4WearStickShift) + half - 128;
+	}
+
+private:
+	static inline void bump(uint32_t *count)
+	{
+		__atomic_store_n(count, __atomic_load_n(count, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+	}
+
+	static inline uint32_t DS4WearKeys(const DS4State *state)
+	{
+		// Hat positions 0 - 7 run clockwise from north; diagonals hold two directions.
+		static const uint8_t kHatDirections[8] = { 0x1, 0x3, 0x2, 0x6, 0x4, 0xC, 0x8, 0x9 };
+		uint32_t hat = (state->hat < 8) ? kHatDirections[state->hat] : 0;
+
+		return (state->buttons & 0x3FFF) | hat << 14;
+	}
+
+	static inline unsigned DS4WearDurationBin(uint64_t nanoseconds)
+	{
+		uint64_t ms = nanoseconds / 1000000;
+		unsigned bin = 0;
+		while (ms >= 2 && bin < kDS4WearDurationBins - 1) {
+			ms >>= 1;
+			bin++;
+		}
+		return bin;
+	}
+};
+
+// Names of the keys in the exported press durations, indexed like presses.
+static const char *const DS4WearKeyNames[kDS4WearKeyCount] = {
+	"Square", "Cross", "Circle", "Triangle", "L1", "R1", "L2", "R2",
+	"Share", "Options", "L3", "R3", "PS", "Touchpad",
+	"Up", "Right", "Down", "Left"
+};
+
+#endif
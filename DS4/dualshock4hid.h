@@ -243,4 +243,329 @@ static const unsigned char ReportDescriptor[] = {
 	0xC0				//	End Collection
 };
 
+// Appended to ReportDescriptor when the touchpad drives the pointer. Report 48
+// is not used by the pad itself.
+static const unsigned char PointerReportDescriptor[] = {
+	0x05, 0x01,			//	Usage Page (Generic Desktop Controls)
+	0x09, 0x02,			//	Usage (Mouse)
+	0xA1, 0x01,			//	Collection (Application)
+	0x85, 0x30,			//	Report ID (48)
+	0x09, 0x01,			//	Usage (Pointer)
+	0xA1, 0x00,			//	Collection (Physical)
+	0x05, 0x09,			//	Usage Page (Button)
+	0x19, 0x01,			//	Usage Minimum (0x01)
+	0x29, 0x02,			//	Usage Maximum (0x02)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x01,			//	Logical Maximum (1)
+	0x75, 0x01,			//	Report Size (1)
+	0x95, 0x02,			//	Report Count (2)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x75, 0x06,			//	Report Size (6)
+	0x95, 0x01,			//	Report Count (1)
+	0x81, 0x03,			//	Input (Const,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x05, 0x01,			//	Usage Page (Generic Desktop Controls)
+	0x09, 0x30,			//	Usage (X)
+	0x09, 0x31,			//	Usage (Y)
+	0x15, 0x81,			//	Logical Minimum (-127)
+	0x25, 0x7F,			//	Logical Maximum (127)
+	0x75, 0x08,			//	Report Size (8)
+	0x95, 0x02,			//	Report Count (2)
+	0x81, 0x06,			//	Input (Data,Var,Rel,No Wrap,Linear,Preferred State,No Null Position)
+	0xC0,				//	End Collection
+	0xC0				//	End Collection
+};
+
+// Alternate layout for titles that only understand Xbox style gamepads. Input
+// report 1 is rewritten to match by DS4TranslateXbox; output report 5 is the
+// pad's own, so rumble and the light bar keep working.
+static const unsigned char XboxReportDescriptor[] = {
+	0x05, 0x01,			//	Usage Page (Generic Desktop Controls)
+	0x09, 0x05,			//	Usage (Game Pad)
+	0xA1, 0x01,			//	Collection (Application)
+	0x85, 0x01,			//	Report ID (1)
+	0x09, 0x01,			//	Usage (Pointer)
+	0xA1, 0x00,			//	Collection (Physical)
+	0x09, 0x30,			//	Usage (X)
+	0x09, 0x31,			//	Usage (Y)
+	0x09, 0x33,			//	Usage (Rx)
+	0x09, 0x34,			//	Usage (Ry)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x27, 0xFF, 0xFF, 0x00, 0x00,	//	Logical Maximum (65535)
+	0x75, 0x10,			//	Report Size (16)
+	0x95, 0x04,			//	Report Count (4)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0xC0,				//	End Collection
+	0x09, 0x32,			//	Usage (Z)
+	0x09, 0x35,			//	Usage (Rz)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x26, 0xFF, 0x00,	//	Logical Maximum (255)
+	0x75, 0x08,			//	Report Size (8)
+	0x95, 0x02,			//	Report Count (2)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x05, 0x09,			//	Usage Page (Button)
+	0x19, 0x01,			//	Usage Minimum (0x01)
+	0x29, 0x0B,			//	Usage Maximum (0x0B)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x01,			//	Logical Maximum (1)
+	0x75, 0x01,			//	Report Size (1)
+	0x95, 0x0B,			//	Report Count (11)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x95, 0x05,			//	Report Count (5)
+	0x81, 0x03,			//	Input (Const,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x05, 0x01,			//	Usage Page (Generic Desktop Controls)
+	0x09, 0x39,			//	Usage (Hat switch)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x07,			//	Logical Maximum (7)
+	0x35, 0x00,			//	Physical Minimum (0)
+	0x46, 0x3B, 0x01,	//	Physical Maximum (315)
+	0x65, 0x14,			//	Unit (System: English Rotation, Length: Centimeter)
+	0x75, 0x04,			//	Report Size (4)
+	0x95, 0x01,			//	Report Count (1)
+	0x81, 0x42,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,Null State)
+	0x65, 0x00,			//	Unit (None)
+	0x81, 0x03,			//	Input (Const,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x06, 0x00, 0xFF,	//	Usage Page (Vendor Defined 0xFF00)
+	0x85, 0x05,			//	Report ID (5)
+	0x09, 0x22,			//	Usage (0x22)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x26, 0xFF, 0x00,	//	Logical Maximum (255)
+	0x75, 0x08,			//	Report Size (8)
+	0x95, 0x1F,			//	Report Count (31)
+	0x91, 0x02,			//	Output (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+	0xC0				//	End Collection
+};
+
+// Only what ordinary clients use: input report 1, output report 5, and the
+// calibration, pairing and firmware feature reports. The other vendor feature
+// reports stay reachable through getReport and setReport, which accept any
+// feature report the pad has.
+static const unsigned char CompactReportDescriptor[] = {
+	0x05, 0x01,			//	Usage Page (Generic Desktop Controls)
+	0x09, 0x05,			//	Usage (Game Pad)
+	0xA1, 0x01,			//	Collection (Application)
+	0x85, 0x01,			//	Report ID (1)
+	0x09, 0x30,			//	Usage (X)
+	0x09, 0x31,			//	Usage (Y)
+	0x09, 0x32,			//	Usage (Z)
+	0x09, 0x35,			//	Usage (Rz)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x26, 0xFF, 0x00,	//	Logical Maximum (255)
+	0x75, 0x08,			//	Report Size (8)
+	0x95, 0x04,			//	Report Count (4)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x09, 0x39,			//	Usage (Hat switch)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x07,			//	Logical Maximum (7)
+	0x35, 0x00,			//	Physical Minimum (0)
+	0x46, 0x3B, 0x01,	//	Physical Maximum (315)
+	0x65, 0x14,			//	Unit (System: English Rotation, Length: Centimeter)
+	0x75, 0x04,			//	Report Size (4)
+	0x95, 0x01,			//	Report Count (1)
+	0x81, 0x42,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,Null State)
+	0x65, 0x00,			//	Unit (None)
+	0x05, 0x09,			//	Usage Page (Button)
+	0x19, 0x01,			//	Usage Minimum (0x01)
+	0x29, 0x0E,			//	Usage Maximum (0x0E)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x01,			//	Logical Maximum (1)
+	0x75, 0x01,			//	Report Size (1)
+	0x95, 0x0E,			//	Report Count (14)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x06, 0x00, 0xFF,	//	Usage Page (Vendor Defined 0xFF00)
+	0x09, 0x20,			//	Usage (0x20)
+	0x75, 0x06,			//	Report Size (6)
+	0x95, 0x01,			//	Report Count (1)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x7F,			//	Logical Maximum (127)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x05, 0x01,			//	Usage Page (Generic Desktop Controls)
+	0x09, 0x33,			//	Usage (Rx)
+	0x09, 0x34,			//	Usage (Ry)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x26, 0xFF, 0x00,	//	Logical Maximum (255)
+	0x75, 0x08,			//	Report Size (8)
+	0x95, 0x02,			//	Report Count (2)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x06, 0x00, 0xFF,	//	Usage Page (Vendor Defined 0xFF00)
+	0x09, 0x21,			//	Usage (0x21)
+	0x95, 0x36,			//	Report Count (54)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x85, 0x05,			//	Report ID (5)
+	0x09, 0x22,			//	Usage (0x22)
+	0x95, 0x1F,			//	Report Count (31)
+	0x91, 0x02,			//	Output (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+	0x85, 0x02,			//	Report ID (2)
+	0x09, 0x24,			//	Usage (0x24)
+	0x95, 0x24,			//	Report Count (36)
+	0xB1, 0x02,			//	Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+	0x85, 0x12,			//	Report ID (18)
+	0x06, 0x02, 0xFF,	//	Usage Page (Vendor Defined 0xFF02)
+	0x09, 0x21,			//	Usage (0x21)
+	0x95, 0x0F,			//	Report Count (15)
+	0xB1, 0x02,			//	Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+	0x85, 0x13,			//	Report ID (19)
+	0x09, 0x22,			//	Usage (0x22)
+	0x95, 0x16,			//	Report Count (22)
+	0xB1, 0x02,			//	Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+	0x06, 0x80, 0xFF,	//	Usage Page (Vendor Defined 0xFF80)
+	0x85, 0xA3,			//	Report ID (163)
+	0x09, 0x43,			//	Usage (0x43)
+	0x95, 0x30,			//	Report Count (48)
+	0xB1, 0x02,			//	Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+	0xC0				//	End Collection
+};
+
+// Native sticks and buttons, followed by the motion sensors, battery and
+// touchpad as standard usages instead of the opaque vendor block, so clients
+// can read them through the HID element API. Input report 1 is reshaped to
+// match by DS4TranslateSplit; output and feature reports are as in the
+// compact descriptor.
+static const unsigned char SplitReportDescriptor[] = {
+	0x05, 0x01,			//	Usage Page (Generic Desktop Controls)
+	0x09, 0x05,			//	Usage (Game Pad)
+	0xA1, 0x01,			//	Collection (Application)
+	0x85, 0x01,			//	Report ID (1)
+	0x09, 0x30,			//	Usage (X)
+	0x09, 0x31,			//	Usage (Y)
+	0x09, 0x32,			//	Usage (Z)
+	0x09, 0x35,			//	Usage (Rz)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x26, 0xFF, 0x00,	//	Logical Maximum (255)
+	0x75, 0x08,			//	Report Size (8)
+	0x95, 0x04,			//	Report Count (4)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x09, 0x39,			//	Usage (Hat switch)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x07,			//	Logical Maximum (7)
+	0x35, 0x00,			//	Physical Minimum (0)
+	0x46, 0x3B, 0x01,	//	Physical Maximum (315)
+	0x65, 0x14,			//	Unit (System: English Rotation, Length: Centimeter)
+	0x75, 0x04,			//	Report Size (4)
+	0x95, 0x01,			//	Report Count (1)
+	0x81, 0x42,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,Null State)
+	0x65, 0x00,			//	Unit (None)
+	0x05, 0x09,			//	Usage Page (Button)
+	0x19, 0x01,			//	Usage Minimum (0x01)
+	0x29, 0x0E,			//	Usage Maximum (0x0E)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x01,			//	Logical Maximum (1)
+	0x75, 0x01,			//	Report Size (1)
+	0x95, 0x0E,			//	Report Count (14)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x06, 0x00, 0xFF,	//	Usage Page (Vendor Defined 0xFF00)
+	0x09, 0x20,			//	Usage (0x20)
+	0x75, 0x06,			//	Report Size (6)
+	0x95, 0x01,			//	Report Count (1)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x7F,			//	Logical Maximum (127)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x05, 0x01,			//	Usage Page (Generic Desktop Controls)
+	0x09, 0x33,			//	Usage (Rx)
+	0x09, 0x34,			//	Usage (Ry)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x26, 0xFF, 0x00,	//	Logical Maximum (255)
+	0x75, 0x08,			//	Report Size (8)
+	0x95, 0x02,			//	Report Count (2)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x09, 0x40,			//	Usage (Vx)
+	0x09, 0x41,			//	Usage (Vy)
+	0x09, 0x42,			//	Usage (Vz)
+	0x09, 0x43,			//	Usage (Vbrx)
+	0x09, 0x44,			//	Usage (Vbry)
+	0x09, 0x45,			//	Usage (Vbrz)
+	0x16, 0x00, 0x80,	//	Logical Minimum (-32768)
+	0x26, 0xFF, 0x7F,	//	Logical Maximum (32767)
+	0x75, 0x10,			//	Report Size (16)
+	0x95, 0x06,			//	Report Count (6)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x05, 0x06,			//	Usage Page (Generic Device Controls)
+	0x09, 0x20,			//	Usage (Battery Strength)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x64,			//	Logical Maximum (100)
+	0x75, 0x08,			//	Report Size (8)
+	0x95, 0x01,			//	Report Count (1)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x05, 0x0D,			//	Usage Page (Digitizer)
+	0x09, 0x05,			//	Usage (Touch Pad)
+	0xA1, 0x02,			//	Collection (Logical)
+	0x09, 0x22,			//	Usage (Finger)
+	0xA1, 0x02,			//	Collection (Logical)
+	0x09, 0x42,			//	Usage (Tip Switch)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x01,			//	Logical Maximum (1)
+	0x75, 0x01,			//	Report Size (1)
+	0x95, 0x01,			//	Report Count (1)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x09, 0x51,			//	Usage (Contact Identifier)
+	0x25, 0x7F,			//	Logical Maximum (127)
+	0x75, 0x07,			//	Report Size (7)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x05, 0x01,			//	Usage Page (Generic Desktop Controls)
+	0x09, 0x30,			//	Usage (X)
+	0x26, 0x7F, 0x07,	//	Logical Maximum (1919)
+	0x75, 0x0C,			//	Report Size (12)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x09, 0x31,			//	Usage (Y)
+	0x26, 0xAE, 0x03,	//	Logical Maximum (942)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x05, 0x0D,			//	Usage Page (Digitizer)
+	0xC0,				//	End Collection
+	0x09, 0x22,			//	Usage (Finger)
+	0xA1, 0x02,			//	Collection (Logical)
+	0x09, 0x42,			//	Usage (Tip Switch)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x01,			//	Logical Maximum (1)
+	0x75, 0x01,			//	Report Size (1)
+	0x95, 0x01,			//	Report Count (1)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x09, 0x51,			//	Usage (Contact Identifier)
+	0x25, 0x7F,			//	Logical Maximum (127)
+	0x75, 0x07,			//	Report Size (7)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x05, 0x01,			//	Usage Page (Generic Desktop Controls)
+	0x09, 0x30,			//	Usage (X)
+	0x26, 0x7F, 0x07,	//	Logical Maximum (1919)
+	0x75, 0x0C,			//	Report Size (12)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x09, 0x31,			//	Usage (Y)
+	0x26, 0xAE, 0x03,	//	Logical Maximum (942)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0x05, 0x0D,			//	Usage Page (Digitizer)
+	0xC0,				//	End Collection
+	0x09, 0x54,			//	Usage (Contact Count)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x25, 0x02,			//	Logical Maximum (2)
+	0x75, 0x08,			//	Report Size (8)
+	0x95, 0x01,			//	Report Count (1)
+	0x81, 0x02,			//	Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+	0xC0,				//	End Collection
+	0x06, 0x00, 0xFF,	//	Usage Page (Vendor Defined 0xFF00)
+	0x85, 0x05,			//	Report ID (5)
+	0x09, 0x22,			//	Usage (0x22)
+	0x15, 0x00,			//	Logical Minimum (0)
+	0x26, 0xFF, 0x00,	//	Logical Maximum (255)
+	0x75, 0x08,			//	Report Size (8)
+	0x95, 0x1F,			//	Report Count (31)
+	0x91, 0x02,			//	Output (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+	0x85, 0x02,			//	Report ID (2)
+	0x09, 0x24,			//	Usage (0x24)
+	0x95, 0x24,			//	Report Count (36)
+	0xB1, 0x02,			//	Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+	0x85, 0x12,			//	Report ID (18)
+	0x06, 0x02, 0xFF,	//	Usage Page (Vendor Defined 0xFF02)
+	0x09, 0x21,			//	Usage (0x21)
+	0x95, 0x0F,			//	Report Count (15)
+	0xB1, 0x02,			//	Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+	0x85, 0x13,			//	Report ID (19)
+	0x09, 0x22,			//	Usage (0x22)
+	0x95, 0x16,			//	Report Count (22)
+	0xB1, 0x02,			//	Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+	0x06, 0x80, 0xFF,	//	Usage Page (Vendor Defined 0xFF80)
+	0x85, 0xA3,			//	Report ID (163)
+	0x09, 0x43,			//	Usage (0x43)
+	0x95, 0x30,			//	Report Count (48)
+	0xB1, 0x02,			//	Feature (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position,Non-volatile)
+	0xC0				//	End Collection
+};
+
 #endif
@@ -0,0 +1,144 @@
+//
+//  DS4HostKernels.h
+//  DS4 tools
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4HostKernels_h
+#define DS4_DS4HostKernels_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DS4ReportModes.h"
+
+// Instruction set levels host kernels can be built for, lowest first.
+enum HostISA {
+	kHostISAScalar,
+	kHostISASSE2,
+	kHostISASSSE3,
+	kHostISAAVX2,
+	kHostISAAVX512,
+	kHostISACount
+};
+
+static const char *const HostISANames[kHostISACount] = {
+	"scalar",
+	"sse2",
+	"ssse3",
+	"avx2",
+	"avx512"
+};
+
+static inline bool HostSupportsISA(HostISA isa)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	switch (isa) {
+		case kHostISAScalar:	return true;
+		case kHostISASSE2:		return __builtin_cpu_supports("sse2");
+		case kHostISASSSE3:		return __builtin_cpu_supports("ssse3");
+		case kHostISAAVX2:		return __builtin_cpu_supports("avx2");
+		case kHostISAAVX512:	return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+		default:				return false;
+	}
+#else
+	return isa == kHostISAScalar;
+#endif
+}
+
+// Every vectorized kernel is listed here next to its scalar reference, which
+// is the one the kext runs. Kernels take a payload and write a report.
+typedef size_t (*HostByteKernel)(const uint8_t *in, uint8_t *out);
+
+struct HostKernelVariant {
+	const char		*kernel;
+	HostISA			isa;
+	HostByteKernel	function;
+	size_t			inputLength;
+};
+
+static const HostKernelVariant HostKernelVariants[] = {
+	{ "translate/xbox", kHostISAScalar, DS4TranslateXbox, 64 },
+#ifdef DS4_HAVE_XBOX_SSSE3
+	{ "translate/xbox", kHostISASSSE3, DS4TranslateXboxSSSE3, 64 },
+#endif
+	{ "translate/split", kHostISAScalar, DS4TranslateSplit, 64 }
+};
+
+#define kHostKernelVariantCount	(sizeof(HostKernelVariants) / sizeof(HostKernelVariants[0]))
+
+static inline const HostKernelVariant *HostKernelReference(const char *kernel)
+{
+	for (size_t i = 0; i < kHostKernelVariantCount; i++) {
+		const HostKernelVariant *variant = &HostKernelVariants[i];
+		if (variant->isa == kHostISAScalar && !strcmp(variant->kernel, kernel))
+			return variant;
+	}
+	return NULL;
+}
+
+// The level kernels are picked for: the highest the CPU supports, or the one
+// named by DS4_ISA when that is lower, so slower paths can be benchmarked on
+// a fast machine. Decided on first use and fixed from then on.
+static inline HostISA HostDetectLevel(void)
+{
+	int level = kHostISAScalar;
+	while (level + 1 < kHostISACount && HostSupportsISA((HostISA)(level + 1)))
+		level++;
+
+	const char *forced = getenv("DS4_ISA");
+	if (forced == NULL || *forced == '\0')
+		return (HostISA)level;
+
+	for (int isa = 0; isa < kHostISACount; isa++) {
+		if (strcmp(forced, HostISANames[isa]))
+			continue;
+		if (isa > level) {
+			fprintf(stderr, "DS4_ISA=%s is not supported here, using %s\n", forced, HostISANames[level]);
+			return (HostISA)level;
+		}
+		return (HostISA)isa;
+	}
+
+	fprintf(stderr, "DS4_ISA=%s is not a known level, using %s\n", forced, HostISANames[level]);
+	return (HostISA)level;
+}
+
+static inline HostISA HostDispatchLevel(void)
+{
+	static const HostISA level = HostDetectLevel();
+	return level;
+}
+
+// Returns the fastest variant of the kernel whose scalar reference is given
+// that the dispatch level allows, or the reference itself. Callers resolve
+// once and keep the pointer, so there is no cost per call beyond the
+// indirect call the report path already makes.
+static inline HostByteKernel HostResolveKernel(HostByteKernel reference)
+{
+	const char *kernel = NULL;
+	for (size_t i = 0; i < kHostKernelVariantCount; i++) {
+		if (HostKernelVariants[i].function == reference)
+			kernel = HostKernelVariants[i].kernel;
+	}
+	if (kernel == NULL)
+		return reference;
+
+	HostISA level = HostDispatchLevel();
+	const HostKernelVariant *best = NULL;
+	for (size_t i = 0; i < kHostKernelVariantCount; i++) {
+		const HostKernelVariant *variant = &HostKernelVariants[i];
+		if (strcmp(variant->kernel, kernel) || variant->isa > level)
+			continue;
+		if (best == NULL || variant->isa > best->isa)
+			best = variant;
+	}
+
+	return best != NULL ? best->function : reference;
+}
+
+#endif
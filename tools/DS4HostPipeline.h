@@ -0,0 +1,204 @@
+//
+//  DS4HostPipeline.h
+//  DS4 tools
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+
+#ifndef DS4_DS4HostPipeline_h
+#define DS4_DS4HostPipeline_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <string>
+#include <vector>
+
+#include "DS4Capture.h"
+#include "DS4Counters.h"
+#include "DS4Report.h"
+#include "DS4TouchGestures.h"
+#include "DS4Trackpad.h"
+#include "DS4TouchZones.h"
+#include "DS4MotionGestures.h"
+#include "DS4ReportModes.h"
+#include "DS4HostKernels.h"
+
+// A capture file loaded into memory, with its records indexed.
+struct HostCapture {
+	std::string						path;
+	std::vector<uint8_t>			bytes;
+	std::vector<DS4CaptureRecord>	records;
+	DS4Transport					transport;
+	DS4Variant						variant;
+	
+	bool load(const char *file)
+	{
+		FILE *fp = fopen(file, "rb");
+		if (fp == NULL)
+			return false;
+		
+		uint8_t chunk[4096];
+		size_t got;
+		while ((got = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+			bytes.insert(bytes.end(), chunk, chunk + got);
+		fclose(fp);
+		
+		path = file;
+		return index();
+	}
+	
+	bool index(void)
+	{
+		uint8_t t, v;
+		if (!DS4CaptureReadHeader(bytes.data(), bytes.size(), &t, &v) ||
+			t >= kDS4TransportCount || v >= kDS4VariantCount)
+			return false;
+		
+		transport = (DS4Transport)t;
+		variant = (DS4Variant)v;
+		
+		DS4CaptureRecord record;
+		size_t offset = kDS4CaptureHeaderLength;
+		records.clear();
+		while (DS4CaptureNextRecord(bytes.data(), bytes.size(), &offset, &record))
+			records.push_back(record);
+		
+		return true;
+	}
+};
+
+// Host-side model of the driver's per-report path. Stages are run in the same
+// order SonyPlaystationDualShock4::handleReport runs them.
+struct HostPipeline {
+	DS4DecodeFunction	decode;
+	const DS4ReportModeInfo	*mode;
+	DS4TranslateFunction	translate;			//	mode->translate, or a faster variant of it
+	unsigned			payload;
+	uint8_t				modeReport[64];
+	DS4State			state;
+	DS4Counters			counters;
+	DS4TouchGestures	gestures;
+	DS4MotionGestures	motion;
+	DS4Trackpad			trackpad;
+	DS4PointerReport	pointer;
+	DS4TouchZones		zones;
+	
+	void reset(DS4Transport transport, DS4Variant variant, DS4ReportMode reportMode = kDS4ReportModeNative)
+	{
+		decode = DS4SelectDecoder(transport, variant);
+		mode = &DS4ReportModes[reportMode];
+		translate = (mode->translate != NULL) ? HostResolveKernel(mode->translate) : NULL;
+		payload = (transport == kDS4TransportUSB) ? 1 : 3;
+		memset(&state, 0, sizeof(state));
+		counters.reset();
+		gestures.reset();
+		motion.reset();
+		trackpad.reset();
+		zones.configure(kDS4TouchZonesGrid3x3, false);
+	}
+	
+	void process(const DS4CaptureRecord &record)
+	{
+		if (record.direction != kDS4CaptureInput)
+			return;
+		
+		counters.add(kDS4CounterReportsReceived);
+		
+		DS4DecodeResult result = decode(record.bytes, record.length, &state);
+		switch (result) {
+			case kDS4DecodeOK:
+				counters.add(kDS4CounterReportsDecoded);
+				gestures.process(&state, record.timestamp);
+				motion.process(&state, record.timestamp);
+				zones.process(&state);
+				break;
+			case kDS4DecodeIgnored:
+				break;
+			case kDS4DecodeBadCRC:
+				counters.add(kDS4CounterCRCFailures);
+				// fall through
+			case kDS4DecodeTruncated:
+				counters.add(kDS4CounterReportsDropped);
+				return;
+		}
+		
+		if (translate != NULL && result == kDS4DecodeOK)
+			translate(record.bytes + payload, modeReport);
+		
+		trackpad.process(&state, &pointer);
+	}
+};
+
+// Builds an in-memory capture of a pad being moved around, for runs where no
+// capture files are supplied.
+static inline void HostSynthesizeCapture(HostCapture *capture, DS4Transport transport, DS4Variant variant, unsigned reports)
+{
+	const unsigned length = (transport == kDS4TransportUSB) ? (unsigned)DS4TransportTraits<kDS4TransportUSB>::kReportLength
+															: (unsigned)DS4TransportTraits<kDS4TransportBluetooth>::kReportLength;
+	const unsigned payload = (transport == kDS4TransportUSB) ? 1 : 3;
+	const uint64_t interval = 4000000;
+	
+	capture->path = "synthetic";
+	capture->bytes.assign(kDS4CaptureHeaderLength, 0);
+	DS4CaptureWriteHeader(capture->bytes.data(), transport, variant);
+	
+	for (unsigned i = 0; i < reports; i++) {
+		uint8_t report[DS4TransportTraits<kDS4TransportBluetooth>::kReportLength];
+		memset(report, 0, sizeof(report));
+		
+		uint8_t *p = report + payload;
+		report[0] = (transport == kDS4TransportUSB) ? 0x01 : 0x11;
+		if (transport == kDS4TransportBluetooth)
+			report[1] = 0xC0;
+		
+		double phase = i * 0.02;
+		p[kDS4OffsetLeftX + 0] = (uint8_t)(128 + 127 * sin(phase));
+		p[kDS4OffsetLeftX + 1] = (uint8_t)(128 + 127 * cos(phase));
+		p[kDS4OffsetLeftX + 2] = (uint8_t)(128 + 60 * sin(phase * 3));
+		p[kDS4OffsetLeftX + 3] = (uint8_t)(128 + 60 * cos(phase * 5));
+		p[kDS4OffsetButtons] = (uint8_t)(((i / 50) % 2 ? 0x20 : 0x00) | kDS4HatReleased);
+		p[kDS4OffsetButtons + 2] = (uint8_t)((i & 0x3F) << 2);
+		p[kDS4OffsetL2] = (uint8_t)(i * 3);
+		p[kDS4OffsetTimestamp] = (uint8_t)(i * 188);
+		p[kDS4OffsetTimestamp + 1] = (uint8_t)((i * 188) >> 8);
+		for (int axis = 0; axis < 3; axis++) {
+			int16_t gyro = (int16_t)(800 * sin(phase * (axis + 1)));
+			int16_t accel = (int16_t)(axis == 1 ? 8192 : 400 * cos(phase * (axis + 2)));
+			p[kDS4OffsetGyro + axis * 2] = (uint8_t)gyro;
+			p[kDS4OffsetGyro + axis * 2 + 1] = (uint8_t)(gyro >> 8);
+			p[kDS4OffsetAccel + axis * 2] = (uint8_t)accel;
+			p[kDS4OffsetAccel + axis * 2 + 1] = (uint8_t)(accel >> 8);
+		}
+		p[kDS4OffsetStatus] = 0x1B;
+		p[kDS4OffsetTouchPacket] = (uint8_t)i;
+		
+		// One finger sweeping across the pad every 400 reports, second finger absent.
+		unsigned stroke = i % 400;
+		uint8_t *t = p + kDS4OffsetTouch;
+		uint16_t x = (uint16_t)(stroke * kDS4TouchMaxX / 400);
+		uint16_t y = 400;
+		t[0] = (stroke < 300) ? (uint8_t)((i / 400) & 0x7F) : 0x80;
+		t[1] = (uint8_t)x;
+		t[2] = (uint8_t)(((x >> 8) & 0x0F) | ((y & 0x0F) << 4));
+		t[3] = (uint8_t)(y >> 4);
+		t[4] = 0x80;
+		
+		if (transport == kDS4TransportBluetooth) {
+			uint32_t crc = DS4CRC32(kDS4CRC32SeedInput, report, length - 4);
+			for (int b = 0; b < 4; b++)
+				report[length - 4 + b] = (uint8_t)(crc >> (8 * b));
+		}
+		
+		size_t at = capture->bytes.size();
+		capture->bytes.resize(at + kDS4CaptureRecordHeaderLength + length);
+		DS4CaptureWriteRecordHeader(&capture->bytes[at], i * interval, kDS4CaptureInput, (uint16_t)length);
+		memcpy(&capture->bytes[at + kDS4CaptureRecordHeaderLength], report, length);
+	}
+	
+	capture->index();
+}
+
+#endif
@@ -0,0 +1,590 @@
+//
+//  ds4bench.cpp
+//  DS4 tools
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+//  Stage-level and capture-driven benchmarks for the report pipeline, built
+//  on the host from the same sources as the driver. Results are written to
+//  stdout as JSON.
+//
+//	ds4bench [--filter text] [--min-time ms] [--label name] [capture ...]
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "DS4CRC32.h"
+#include "DS4Report.h"
+#include "DS4ReportDescriptor.h"
+#include "DS4Trace.h"
+#include "DS4TouchGestures.h"
+#include "DS4Trackpad.h"
+#include "DS4TouchZones.h"
+#include "DS4Wear.h"
+#include "DS4Output.h"
+#include "DS4FlightRecorder.h"
+#include "DS4Resampler.h"
+#include "DS4InputHistory.h"
+#include "DS4MotionGestures.h"
+#include "DS4ReportModes.h"
+#include "DS4HostPipeline.h"
+
+namespace HID_DS4 {
+	#include "dualshock4hid.h"
+}
+
+#define kBenchSchemaVersion	1
+#define kBenchRepetitions	5
+
+template <typename T> static inline void DoNotOptimize(T const &value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static inline uint64_t NowNS(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct Benchmark {
+	std::string		name;
+	uint32_t		bytesPerOp;
+	void			(*run)(uint64_t iterations, void *context);
+	void			*context;
+};
+
+struct Result {
+	std::string		name;
+	uint64_t		iterations;
+	uint32_t		bytesPerOp;
+	double			nsPerOpMin;
+	double			nsPerOpMedian;
+};
+
+// Fixtures
+
+static HostCapture gSynthetic[kDS4TransportCount];
+
+static std::vector<DS4State> gTouchStates;
+
+static void SetTouch(DS4State *state, int slot, uint8_t id, int x, int y)
+{
+	state->touch[slot].active = true;
+	state->touch[slot].id = id;
+	state->touch[slot].x = (uint16_t)x;
+	state->touch[slot].y = (uint16_t)y;
+}
+
+// One 250 Hz report per state, cycling through a tap, an edge swipe, a two
+// finger scroll and a pinch with idle gaps between them.
+static void SynthesizeTouchStates(std::vector<DS4State> *states, unsigned cycles)
+{
+	uint8_t id = 0;
+
+	for (unsigned c = 0; c < cycles; c++) {
+		for (unsigned i = 0; i < 200; i++) {
+			DS4State state;
+			memset(&state, 0, sizeof(state));
+
+			if (i < 20) {
+				SetTouch(&state, 0, id, 900, 450);
+			} else if (i >= 40 && i < 70) {
+				SetTouch(&state, 0, id + 1, 40 + (i - 40) * 30, 500);
+			} else if (i >= 90 && i < 140) {
+				SetTouch(&state, 0, id + 2, 700, 200 + (i - 90) * 8);
+				SetTouch(&state, 1, id + 3, 1100, 200 + (i - 90) * 8);
+			} else if (i >= 150 && i < 190) {
+				SetTouch(&state, 0, id + 4, 900 - (i - 150) * 10, 450);
+				SetTouch(&state, 1, id + 5, 1000 + (i - 150) * 10, 450);
+			}
+
+			states->push_back(state);
+		}
+		id = (uint8_t)((id + 6) & 0x7F);
+	}
+}
+
+static const uint8_t *FirstInputReport(const HostCapture &capture)
+{
+	return capture.records[0].bytes;
+}
+
+// Stages
+
+static void BenchDescriptorParse(uint64_t iterations, void *)
+{
+	DS4ReportSizes sizes;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		DS4ParseReportSizes(HID_DS4::ReportDescriptor, sizeof(HID_DS4::ReportDescriptor), &sizes);
+		DoNotOptimize(sizes.largest);
+	}
+}
+
+static void BenchDescriptorLookup(uint64_t iterations, void *)
+{
+	static DS4ReportSizes sizes;
+	static bool parsed = DS4ParseReportSizes(HID_DS4::ReportDescriptor, sizeof(HID_DS4::ReportDescriptor), &sizes);
+	uint32_t total = 0;
+
+	DoNotOptimize(parsed);
+	for (uint64_t i = 0; i < iterations; i++) {
+		total += DS4ReportSize(&sizes, kDS4ReportKindFeature, (uint8_t)i);
+		DoNotOptimize(total);
+	}
+}
+
+template <DS4Transport T, DS4Variant V>
+static void BenchDecode(uint64_t iterations, void *)
+{
+	const uint8_t *report = FirstInputReport(gSynthetic[T]);
+	DS4State state;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		DoNotOptimize(report);
+		DoNotOptimize(DS4Decoder<T, V>::decode(report, DS4TransportTraits<T>::kReportLength, &state));
+		DoNotOptimize(&state);
+	}
+}
+
+static void BenchDecodeDispatched(uint64_t iterations, void *)
+{
+	const uint8_t *report = FirstInputReport(gSynthetic[kDS4TransportUSB]);
+	DS4DecodeFunction decode = DS4SelectDecoder(kDS4TransportUSB, kDS4VariantV1);
+	DS4State state;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		DoNotOptimize(decode);
+		DoNotOptimize(report);
+		DoNotOptimize(decode(report, DS4TransportTraits<kDS4TransportUSB>::kReportLength, &state));
+		DoNotOptimize(&state);
+	}
+}
+
+static void BenchCRC32(uint64_t iterations, void *)
+{
+	const uint8_t *report = FirstInputReport(gSynthetic[kDS4TransportBluetooth]);
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		DoNotOptimize(report);
+		DoNotOptimize(DS4CRC32(kDS4CRC32SeedInput, report, DS4TransportTraits<kDS4TransportBluetooth>::kReportLength - 4));
+	}
+}
+
+static void BenchTraceRecord(uint64_t iterations, void *)
+{
+	static DS4TraceBuffer buffer;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		buffer.record(kDS4TraceDecode, i, i + 100, (uint16_t)i);
+		DoNotOptimize(&buffer);
+	}
+}
+
+static void BenchTraceSnapshot(uint64_t iterations, void *)
+{
+	static DS4TraceBuffer buffer;
+	static DS4TraceEvent events[kDS4TraceCapacity];
+
+	for (uint32_t i = 0; i < kDS4TraceCapacity; i++)
+		buffer.record(kDS4TraceDecode, i, i + 100, (uint16_t)i);
+
+	for (uint64_t i = 0; i < iterations; i++)
+		DoNotOptimize(buffer.snapshot(events, kDS4TraceCapacity));
+}
+
+static void BenchTouchGestures(uint64_t iterations, void *)
+{
+	DS4TouchGestures gestures;
+	uint32_t seen = 0;
+
+	gestures.reset();
+
+	uint64_t remaining = iterations, now = 0;
+	while (remaining > 0) {
+		for (size_t s = 0; s < gTouchStates.size() && remaining > 0; s++, remaining--) {
+			DS4State state = gTouchStates[s];
+			gestures.process(&state, now += 4000000);
+			seen |= state.virtualButtons;
+			DoNotOptimize(&state);
+		}
+	}
+
+	DoNotOptimize(seen);
+}
+
+static void BenchTrackpad(uint64_t iterations, void *)
+{
+	DS4Trackpad trackpad;
+	DS4PointerReport pointer;
+	uint32_t sent = 0;
+
+	trackpad.reset();
+
+	uint64_t remaining = iterations;
+	while (remaining > 0) {
+		for (size_t s = 0; s < gTouchStates.size() && remaining > 0; s++, remaining--) {
+			sent += trackpad.process(&gTouchStates[s], &pointer);
+			DoNotOptimize(&pointer);
+		}
+	}
+
+	DoNotOptimize(sent);
+}
+
+static void BenchTouchZones(uint64_t iterations, void *)
+{
+	DS4TouchZones zones;
+	uint32_t seen = 0;
+
+	zones.configure(kDS4TouchZonesGrid3x3, false);
+
+	uint64_t remaining = iterations;
+	while (remaining > 0) {
+		for (size_t s = 0; s < gTouchStates.size() && remaining > 0; s++, remaining--) {
+			zones.process(&gTouchStates[s]);
+			seen |= gTouchStates[s].virtualButtons;
+		}
+	}
+
+	DoNotOptimize(seen);
+}
+
+// Decoded states from the synthetic USB capture, which carries moving sticks,
+// buttons and IMU data.
+static const std::vector<DS4State> &SyntheticStates(void)
+{
+	static std::vector<DS4State> states;
+
+	if (states.empty()) {
+		const HostCapture &capture = gSynthetic[kDS4TransportUSB];
+		DS4State state;
+		memset(&state, 0, sizeof(state));
+		for (size_t r = 0; r < capture.records.size(); r++) {
+			DS4Decoder<kDS4TransportUSB, kDS4VariantV1>::decode(capture.records[r].bytes, capture.records[r].length, &state);
+			states.push_back(state);
+		}
+	}
+
+	return states;
+}
+
+static void BenchMotionGestures(uint64_t iterations, void *)
+{
+	const std::vector<DS4State> &states = SyntheticStates();
+	DS4MotionGestures motion;
+	uint32_t seen = 0;
+
+	motion.reset();
+
+	uint64_t remaining = iterations, now = 0;
+	while (remaining > 0) {
+		for (size_t s = 0; s < states.size() && remaining > 0; s++, remaining--) {
+			DS4State state = states[s];
+			motion.process(&state, now += 4000000);
+			seen |= state.virtualButtons;
+			DoNotOptimize(&state);
+		}
+	}
+
+	DoNotOptimize(seen);
+}
+
+static void BenchWear(uint64_t iterations, void *)
+{
+	const std::vector<DS4State> &states = SyntheticStates();
+	static DS4WearHistograms wear;
+
+	wear.reset();
+
+	uint64_t remaining = iterations, now = 0;
+	while (remaining > 0) {
+		for (size_t s = 0; s < states.size() && remaining > 0; s++, remaining--)
+			wear.record(&states[s], now += 4000000);
+	}
+
+	DoNotOptimize(&wear);
+}
+
+// The report is already in cache on the input path, so the same one is
+// recorded over and over.
+static void BenchFlightRecord(uint64_t iterations, void *)
+{
+	static DS4FlightRecorder recorder;
+	const uint8_t *report = FirstInputReport(gSynthetic[kDS4TransportUSB]);
+
+	recorder.reset(0, 0, 0);
+	for (uint64_t i = 0; i < iterations; i++) {
+		DoNotOptimize(report);
+		recorder.record(kDS4CaptureInput, report, 64, i);
+	}
+
+	DoNotOptimize(&recorder);
+}
+
+// A 1 kHz pad feeding a 250 Hz frame clock: four reports in, one frame out.
+static void BenchResample(uint64_t iterations, void *)
+{
+	static DS4FrameResampler resampler;
+	const HostCapture &capture = gSynthetic[kDS4TransportUSB];
+	uint8_t out[64];
+	uint64_t now = 0;
+
+	resampler.reset(kDS4TransportUSB, 4000000, 0, 1500000);
+	for (uint64_t i = 0; i < iterations; i++) {
+		for (int r = 0; r < 4; r++) {
+			const DS4CaptureRecord &record = capture.records[(i * 4 + r) % capture.records.size()];
+			resampler.push(record.bytes, record.length, now += 1000000);
+		}
+		DoNotOptimize(resampler.frame(now, out));
+		DoNotOptimize(&out);
+	}
+}
+
+static void BenchHistoryRecord(uint64_t iterations, void *)
+{
+	const std::vector<DS4State> &states = SyntheticStates();
+	static DS4InputHistory history;
+
+	history.reset();
+
+	uint64_t remaining = iterations, now = 0;
+	while (remaining > 0) {
+		for (size_t s = 0; s < states.size() && remaining > 0; s++, remaining--)
+			history.record(&states[s], now += 4000000);
+	}
+
+	DoNotOptimize(&history);
+}
+
+// State at a time somewhere in a full history, as a rollback would ask.
+static void BenchHistoryLookup(uint64_t iterations, void *)
+{
+	const std::vector<DS4State> &states = SyntheticStates();
+	static DS4InputHistory history;
+	DS4HistoryEntry entry;
+
+	history.reset();
+	for (uint64_t i = 0; i < 2 * kDS4HistorySlots; i++)
+		history.record(&states[i % states.size()], (i + 1) * 4000000);
+
+	uint64_t first = (kDS4HistorySlots + 1) * 4000000ULL, span = (kDS4HistorySlots - 2) * 4000000ULL;
+	for (uint64_t i = 0; i < iterations; i++) {
+		DoNotOptimize(history.stateAt(first + (i * 2654435761ULL) % span, &entry));
+		DoNotOptimize(&entry);
+	}
+}
+
+// Alternates the light bar so every build has a dirty field to emit.
+static void BenchOutput(uint64_t iterations, void *context)
+{
+	static DS4OutputShadow output;
+	size_t length = 0;
+
+	output.reset((DS4Transport)(uintptr_t)context);
+	for (uint64_t i = 0; i < iterations; i++) {
+		output.setLight((uint8_t)i, 0x40, 0x80);
+		DoNotOptimize(output.build(&length));
+	}
+
+	DoNotOptimize(length);
+}
+
+static void BenchTranslate(uint64_t iterations, void *context)
+{
+	DS4TranslateFunction translate = (DS4TranslateFunction)context;
+	const uint8_t *payload = FirstInputReport(gSynthetic[kDS4TransportUSB]) + 1;
+	uint8_t out[64];
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		DoNotOptimize(payload);
+		DoNotOptimize(translate(payload, out));
+		DoNotOptimize(&out);
+	}
+}
+
+// End to end
+
+static void BenchCapture(uint64_t iterations, void *context)
+{
+	const HostCapture *capture = (const HostCapture *)context;
+	HostPipeline pipeline;
+
+	pipeline.reset(capture->transport, capture->variant);
+
+	uint64_t remaining = iterations;
+	while (remaining > 0) {
+		for (size_t r = 0; r < capture->records.size() && remaining > 0; r++, remaining--)
+			pipeline.process(capture->records[r]);
+	}
+
+	DoNotOptimize(pipeline.counters.get(kDS4CounterReportsDecoded));
+}
+
+// Runner
+
+static double TimeOnce(const Benchmark &bench, uint64_t iterations)
+{
+	uint64_t start = NowNS();
+	bench.run(iterations, bench.context);
+	return (double)(NowNS() - start);
+}
+
+static Result Run(const Benchmark &bench, double minTimeNS)
+{
+	uint64_t iterations = 1;
+	double elapsed;
+
+	// Grow the iteration count until one repetition takes a measurable slice of the budget.
+	while ((elapsed = TimeOnce(bench, iterations)) < minTimeNS / 10 && iterations < (1ULL << 40))
+		iterations *= 2;
+
+	double target = minTimeNS / kBenchRepetitions;
+	if (elapsed < target)
+		iterations = (uint64_t)(iterations * (target / std::max(elapsed, 1.0))) + 1;
+
+	std::vector<double> samples;
+	for (int i = 0; i < kBenchRepetitions; i++)
+		samples.push_back(TimeOnce(bench, iterations) / iterations);
+	std::sort(samples.begin(), samples.end());
+
+	Result result;
+	result.name = bench.name;
+	result.iterations = iterations;
+	result.bytesPerOp = bench.bytesPerOp;
+	result.nsPerOpMin = samples.front();
+	result.nsPerOpMedian = samples[samples.size() / 2];
+	return result;
+}
+
+static void PrintJSONString(const std::string &text)
+{
+	putchar('"');
+	for (size_t i = 0; i < text.size(); i++) {
+		unsigned char c = (unsigned char)text[i];
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c < 0x20)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+	putchar('"');
+}
+
+static void PrintResults(const std::string &label, const std::vector<Result> &results)
+{
+	printf("{\n  \"schema\": %d,\n  \"label\": ", kBenchSchemaVersion);
+	PrintJSONString(label);
+	printf(",\n  \"compiler\": ");
+	PrintJSONString(__VERSION__);
+	printf(",\n  \"isa\": ");
+	PrintJSONString(HostISANames[HostDispatchLevel()]);
+	printf(",\n  \"benchmarks\": [");
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result &r = results[i];
+		printf("%s\n    {\"name\": ", i ? "," : "");
+		PrintJSONString(r.name);
+		printf(", \"iterations\": %llu, \"bytes_per_op\": %u, \"ns_per_op_min\": %.3f, \"ns_per_op_median\": %.3f}",
+			   (unsigned long long)r.iterations, r.bytesPerOp, r.nsPerOpMin, r.nsPerOpMedian);
+	}
+
+	printf("\n  ]\n}\n");
+}
+
+static void Usage(void)
+{
+	fprintf(stderr, "usage: ds4bench [--filter text] [--min-time ms] [--label name] [capture ...]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *filter = NULL;
+	std::string label = "unlabeled";
+	double minTimeNS = 200e6;
+	std::vector<HostCapture> captures;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+			filter = argv[++i];
+		} else if (!strcmp(argv[i], "--min-time") && i + 1 < argc) {
+			minTimeNS = atof(argv[++i]) * 1e6;
+		} else if (!strcmp(argv[i], "--label") && i + 1 < argc) {
+			label = argv[++i];
+		} else if (argv[i][0] == '-') {
+			Usage();
+		} else {
+			captures.push_back(HostCapture());
+			if (!captures.back().load(argv[i])) {
+				fprintf(stderr, "ds4bench: cannot read capture %s\n", argv[i]);
+				return 1;
+			}
+		}
+	}
+
+	HostSynthesizeCapture(&gSynthetic[kDS4TransportUSB], kDS4TransportUSB, kDS4VariantV1, 2000);
+	HostSynthesizeCapture(&gSynthetic[kDS4TransportBluetooth], kDS4TransportBluetooth, kDS4VariantV1, 2000);
+	SynthesizeTouchStates(&gTouchStates, 10);
+
+	std::vector<Benchmark> benches;
+	benches.push_back((Benchmark){ "descriptor/parse", sizeof(HID_DS4::ReportDescriptor), BenchDescriptorParse, NULL });
+	benches.push_back((Benchmark){ "descriptor/lookup", 0, BenchDescriptorLookup, NULL });
+	benches.push_back((Benchmark){ "decode/usb/v1", 64, BenchDecode<kDS4TransportUSB, kDS4VariantV1>, NULL });
+	benches.push_back((Benchmark){ "decode/usb/adapter", 64, BenchDecode<kDS4TransportUSB, kDS4VariantAdapter>, NULL });
+	benches.push_back((Benchmark){ "decode/usb/dispatched", 64, BenchDecodeDispatched, NULL });
+	benches.push_back((Benchmark){ "decode/bt/v1", 78, BenchDecode<kDS4TransportBluetooth, kDS4VariantV1>, NULL });
+	benches.push_back((Benchmark){ "crc32/bt-input", 74, BenchCRC32, NULL });
+	benches.push_back((Benchmark){ "trace/record", 0, BenchTraceRecord, NULL });
+	benches.push_back((Benchmark){ "trace/snapshot", 0, BenchTraceSnapshot, NULL });
+	benches.push_back((Benchmark){ "gestures/touch", 0, BenchTouchGestures, NULL });
+	benches.push_back((Benchmark){ "trackpad/pointer", 0, BenchTrackpad, NULL });
+	benches.push_back((Benchmark){ "zones/grid3x3", 0, BenchTouchZones, NULL });
+	benches.push_back((Benchmark){ "gestures/motion", 0, BenchMotionGestures, NULL });
+	benches.push_back((Benchmark){ "wear/record", 0, BenchWear, NULL });
+	benches.push_back((Benchmark){ "flight/record", 64, BenchFlightRecord, NULL });
+	benches.push_back((Benchmark){ "resample/frame", 256, BenchResample, NULL });
+	benches.push_back((Benchmark){ "history/record", 0, BenchHistoryRecord, NULL });
+	benches.push_back((Benchmark){ "history/lookup", 0, BenchHistoryLookup, NULL });
+	benches.push_back((Benchmark){ "output/usb", 32, BenchOutput, (void *)(uintptr_t)kDS4TransportUSB });
+	benches.push_back((Benchmark){ "output/bt", 78, BenchOutput, (void *)(uintptr_t)kDS4TransportBluetooth });
+	benches.push_back((Benchmark){ "translate/xbox/scalar", 64, BenchTranslate, (void *)DS4TranslateXbox });
+	benches.push_back((Benchmark){ "translate/split", 64, BenchTranslate, (void *)DS4TranslateSplit });
+	benches.push_back((Benchmark){ "translate/xbox/dispatched", 64, BenchTranslate, (void *)HostResolveKernel(DS4TranslateXbox) });
+	for (size_t i = 0; i < kHostKernelVariantCount; i++) {
+		const HostKernelVariant *variant = &HostKernelVariants[i];
+		if (variant->isa != kHostISAScalar && variant->isa <= HostDispatchLevel())
+			benches.push_back((Benchmark){ std::string(variant->kernel) + "/" + HostISANames[variant->isa], 64, BenchTranslate, (void *)variant->function });
+	}
+
+	if (captures.empty()) {
+		benches.push_back((Benchmark){ "capture/synthetic-usb", 64, BenchCapture, &gSynthetic[kDS4TransportUSB] });
+		benches.push_back((Benchmark){ "capture/synthetic-bt", 78, BenchCapture, &gSynthetic[kDS4TransportBluetooth] });
+	}
+	for (size_t i = 0; i < captures.size(); i++) {
+		if (captures[i].records.empty())
+			continue;
+		benches.push_back((Benchmark){ "capture/" + captures[i].path, 0, BenchCapture, &captures[i] });
+	}
+
+	std::vector<Result> results;
+	for (size_t i = 0; i < benches.size(); i++) {
+		if (filter != NULL && benches[i].name.find(filter) == std::string::npos)
+			continue;
+		results.push_back(Run(benches[i], minTimeNS));
+	}
+
+	PrintResults(label, results);
+	return 0;
+}
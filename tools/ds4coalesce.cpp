@@ -0,0 +1,254 @@
+//
+//  ds4coalesce.cpp
+//  DS4 tools
+//
+//  Models the driver's report delivery on the host: a thread standing in for
+//  USB completions pushes reports into a DS4ReportQueue at the pad's rate,
+//  and a thread standing in for the work loop drains it whenever a wakeup is
+//  asked for, straight away or through a timer thread after the coalescing
+//  window. For each window it prints the work loop wakeups and context
+//  switches per thousand reports, and how long reports waited to be handled.
+//
+//	ds4coalesce [--reports n] [--interval us] [--burst n] [window us ...]
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "DS4ReportQueue.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static inline uint64_t NowNS(void)
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static inline long ContextSwitches(void)
+{
+#ifdef RUSAGE_THREAD
+	struct rusage usage;
+	if (getrusage(RUSAGE_THREAD, &usage) == 0)
+		return usage.ru_nvcsw + usage.ru_nivcsw;
+#endif
+	return -1;
+}
+
+// A one-shot wakeup, like an event source signalled onto the work loop.
+struct Signal {
+	std::mutex				lock;
+	std::condition_variable	condition;
+	bool					raised;
+	bool					done;
+
+	Signal() : raised(false), done(false) {}
+
+	void raise(void)
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		raised = true;
+		condition.notify_one();
+	}
+
+	void finish(void)
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		done = true;
+		condition.notify_one();
+	}
+
+	// Returns false once finished with nothing raised.
+	bool wait(void)
+	{
+		std::unique_lock<std::mutex> hold(lock);
+		condition.wait(hold, [this]() { return raised || done; });
+		bool wasRaised = raised;
+		raised = false;
+		return wasRaised;
+	}
+};
+
+// Stands in for IOTimerEventSource: raises the work loop's signal once the
+// deadline armed by the first report of a batch has passed.
+struct Timer {
+	std::mutex				lock;
+	std::condition_variable	condition;
+	uint64_t				deadline;		//	0 when not armed
+	bool					done;
+	Signal					*target;
+
+	Timer(Signal *signal) : deadline(0), done(false), target(signal) {}
+
+	void arm(uint64_t at)
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		deadline = at;
+		condition.notify_one();
+	}
+
+	void run(void)
+	{
+		std::unique_lock<std::mutex> hold(lock);
+		while (!done) {
+			if (deadline == 0) {
+				condition.wait(hold);
+				continue;
+			}
+			uint64_t at = deadline;
+			if (NowNS() < at) {
+				condition.wait_until(hold, Clock::time_point(std::chrono::nanoseconds(at)));
+				continue;
+			}
+			deadline = 0;
+			hold.unlock();
+			target->raise();
+			hold.lock();
+		}
+	}
+
+	void finish(void)
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		done = true;
+		condition.notify_one();
+	}
+};
+
+struct Result {
+	unsigned	window;
+	uint64_t	delivered;
+	uint64_t	dropped;
+	uint64_t	wakeups;
+	long		switches;
+	double		meanWaitUS;
+	double		maxWaitUS;
+};
+
+static Result Run(unsigned windowUS, unsigned reports, unsigned intervalUS, unsigned burst)
+{
+	static DS4ReportQueue queue;
+	Signal signal;
+	Timer timer(&signal);
+	Result result;
+
+	memset(&result, 0, sizeof(result));
+	result.window = windowUS;
+	queue.reset();
+
+	std::thread timerThread(&Timer::run, &timer);
+
+	double waitSum = 0;
+	std::thread workLoop([&]() {
+		long startSwitches = ContextSwitches();
+		DS4QueuedReport queued;
+
+		while (signal.wait()) {
+			result.wakeups++;
+			queue.beginDrain();
+			while (queue.pop(&queued)) {
+				double waited = (double)(NowNS() - queued.arrival) / 1000.0;
+				waitSum += waited;
+				result.maxWaitUS = std::max(result.maxWaitUS, waited);
+				result.delivered++;
+			}
+		}
+
+		long endSwitches = ContextSwitches();
+		result.switches = (startSwitches < 0 || endSwitches < 0) ? -1 : endSwitches - startSwitches;
+	});
+
+	// Completions arrive every interval, burst at a time, like a Bluetooth
+	// link handing over several reports at once.
+	Clock::time_point next = Clock::now();
+	for (unsigned sent = 0; sent < reports; ) {
+		std::this_thread::sleep_until(next);
+		next += std::chrono::microseconds(intervalUS);
+
+		for (unsigned b = 0; b < burst && sent < reports; b++, sent++) {
+			bool wake = false;
+			uint64_t now = NowNS();
+			if (!queue.push((uint8_t)(sent & 0x0F), 64, now, &wake)) {
+				result.dropped++;
+				continue;
+			}
+			if (!wake)
+				continue;
+			if (windowUS == 0)
+				signal.raise();
+			else
+				timer.arm(now + windowUS * 1000ULL);
+		}
+	}
+
+	// Let the last batch go through before stopping.
+	std::this_thread::sleep_for(std::chrono::microseconds(windowUS + 2000));
+	timer.finish();
+	timerThread.join();
+	signal.finish();
+	workLoop.join();
+
+	result.meanWaitUS = result.delivered ? waitSum / result.delivered : 0;
+	return result;
+}
+
+static void Usage(void)
+{
+	fprintf(stderr, "usage: ds4coalesce [--reports n] [--interval us] [--burst n] [window us ...]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned reports = 1000, intervalUS = 1000, burst = 1;
+	std::vector<unsigned> windows;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--reports") && i + 1 < argc) {
+			reports = (unsigned)atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--interval") && i + 1 < argc) {
+			intervalUS = (unsigned)atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--burst") && i + 1 < argc) {
+			burst = (unsigned)atoi(argv[++i]);
+		} else if (argv[i][0] == '-' || argv[i][0] < '0' || argv[i][0] > '9') {
+			Usage();
+		} else {
+			windows.push_back((unsigned)atoi(argv[i]));
+		}
+	}
+
+	if (reports == 0 || burst == 0)
+		Usage();
+	if (windows.empty()) {
+		static const unsigned kDefaultWindows[] = { 0, 1000, 2000, 4000 };
+		windows.assign(kDefaultWindows, kDefaultWindows + sizeof(kDefaultWindows) / sizeof(kDefaultWindows[0]));
+	}
+
+	printf("%u reports every %u us, %u at a time\n", reports, intervalUS, burst);
+	printf("%10s %9s %8s %14s %15s %11s %10s\n",
+		   "window us", "reports", "dropped", "wakeups/1000", "switches/1000", "mean wait", "max wait");
+
+	for (size_t w = 0; w < windows.size(); w++) {
+		Result r = Run(windows[w], reports, intervalUS, burst);
+		double scale = r.delivered ? 1000.0 / r.delivered : 0;
+
+		printf("%10u %9llu %8llu %14.1f ", r.window, (unsigned long long)r.delivered,
+			   (unsigned long long)r.dropped, r.wakeups * scale);
+		if (r.switches < 0)
+			printf("%15s", "n/a");
+		else
+			printf("%15.1f", r.switches * scale);
+		printf(" %8.0f us %7.0f us\n", r.meanWaitUS, r.maxWaitUS);
+	}
+
+	return 0;
+}
@@ -0,0 +1,58 @@
+//
+//  ds4desc.cpp
+//  DS4 tools
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+//  Summarizes the report descriptor of each report mode: its length, the
+//  number of HID elements the host stack builds for it, how many reports of
+//  each kind it declares, and how long parsing it takes here.
+//
+//	ds4desc
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "DS4ReportDescriptor.h"
+#include "DS4ReportModes.h"
+
+#define kParseRepetitions	20000
+
+static inline uint64_t NowNS(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(void)
+{
+	printf("%-10s %6s %9s %7s %7s %8s %10s\n", "mode", "bytes", "elements", "inputs", "outputs", "features", "parse ns");
+
+	for (int m = 0; m < kDS4ReportModeCount; m++) {
+		const DS4ReportModeInfo *mode = &DS4ReportModes[m];
+		static DS4ReportSizes sizes;
+
+		uint64_t start = NowNS();
+		for (int i = 0; i < kParseRepetitions; i++) {
+			if (!DS4ParseReportSizes(mode->descriptor, mode->descriptorLength, &sizes)) {
+				fprintf(stderr, "ds4desc: %s descriptor does not parse\n", mode->name);
+				return 1;
+			}
+		}
+		double parseNS = (double)(NowNS() - start) / kParseRepetitions;
+
+		unsigned counts[kDS4ReportKindCount] = { 0, 0, 0 };
+		for (int kind = 0; kind < kDS4ReportKindCount; kind++) {
+			for (int id = 0; id < 256; id++)
+				counts[kind] += sizes.bytes[kind][id] != 0;
+		}
+
+		printf("%-10s %6zu %9u %7u %7u %8u %10.0f\n", mode->name, mode->descriptorLength, sizes.elements,
+			   counts[kDS4ReportKindInput], counts[kDS4ReportKindOutput], counts[kDS4ReportKindFeature], parseNS);
+	}
+
+	return 0;
+}
@@ -0,0 +1,186 @@
+//
+//  ds4diff.cpp
+//  DS4 tools
+//
+//  Runs every vectorized kernel in DS4HostKernels.h against its scalar
+//  reference and reports any input on which the two disagree, in the bytes
+//  written or in the length returned. Inputs are random payloads, biased
+//  towards boundary bytes, plus every input report of the given captures
+//  (the built-in synthetic ones when there are none). Variants for an ISA
+//  the CPU lacks, or above the level DS4_ISA forces, are skipped and listed
+//  as such.
+//
+//	ds4diff [--iterations n] [--seed n] [capture ...]
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "DS4HostKernels.h"
+#include "DS4HostPipeline.h"
+
+#define kDiffOutputLength	128		//	Larger than any report, so overruns show up
+#define kDiffCanary			0xA5
+#define kDiffMaxReported	4
+
+struct DiffInput {
+	uint8_t		bytes[64];
+};
+
+static inline uint64_t XorShift(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+// Half the bytes are uniformly random, the rest are values that sit on the
+// edges of sign, nibble and bit fields.
+static void RandomInput(uint64_t *state, DiffInput *input)
+{
+	static const uint8_t kEdges[] = { 0x00, 0x01, 0x0F, 0x10, 0x7F, 0x80, 0x81, 0xF0, 0xFE, 0xFF };
+
+	for (size_t i = 0; i < sizeof(input->bytes); i++) {
+		uint64_t r = XorShift(state);
+		input->bytes[i] = (r & 1) ? (uint8_t)(r >> 8) : kEdges[(r >> 8) % sizeof(kEdges)];
+	}
+}
+
+static void RecordedInputs(const HostCapture &capture, std::vector<DiffInput> *inputs)
+{
+	const size_t payload = (capture.transport == kDS4TransportUSB) ? 1 : 3;
+
+	for (size_t r = 0; r < capture.records.size(); r++) {
+		const DS4CaptureRecord &record = capture.records[r];
+		if (record.direction != kDS4CaptureInput || record.length <= payload)
+			continue;
+
+		DiffInput input;
+		size_t length = record.length - payload;
+		memset(input.bytes, 0, sizeof(input.bytes));
+		memcpy(input.bytes, record.bytes + payload, length < sizeof(input.bytes) ? length : sizeof(input.bytes));
+		inputs->push_back(input);
+	}
+}
+
+static void PrintBytes(const char *label, const uint8_t *bytes, size_t length)
+{
+	printf("    %-9s", label);
+	for (size_t i = 0; i < length; i++)
+		printf(" %02x", bytes[i]);
+	printf("\n");
+}
+
+// Returns true when both produce the same bytes and length for the input.
+static bool Compare(const HostKernelVariant *reference, const HostKernelVariant *variant, const DiffInput &input, unsigned *reported)
+{
+	uint8_t expected[kDiffOutputLength], actual[kDiffOutputLength];
+
+	memset(expected, kDiffCanary, sizeof(expected));
+	memset(actual, kDiffCanary, sizeof(actual));
+	size_t expectedLength = reference->function(input.bytes, expected);
+	size_t actualLength = variant->function(input.bytes, actual);
+
+	if (expectedLength == actualLength && !memcmp(expected, actual, sizeof(actual)))
+		return true;
+
+	if (*reported < kDiffMaxReported) {
+		size_t shown = expectedLength > actualLength ? expectedLength : actualLength;
+		if (shown > kDiffOutputLength)
+			shown = kDiffOutputLength;
+		printf("  mismatch, returned %zu, expected %zu\n", actualLength, expectedLength);
+		PrintBytes("input", input.bytes, variant->inputLength);
+		PrintBytes("expected", expected, shown);
+		PrintBytes("actual", actual, shown);
+	}
+	(*reported)++;
+
+	return false;
+}
+
+static void Usage(void)
+{
+	fprintf(stderr, "usage: ds4diff [--iterations n] [--seed n] [capture ...]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = 1000000;
+	uint64_t seed = 0x44533444494646ULL;
+	std::vector<HostCapture> captures;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+			iterations = strtoul(argv[++i], NULL, 0);
+		} else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 0);
+		} else if (argv[i][0] == '-') {
+			Usage();
+		} else {
+			captures.push_back(HostCapture());
+			if (!captures.back().load(argv[i])) {
+				fprintf(stderr, "ds4diff: cannot read capture %s\n", argv[i]);
+				return 1;
+			}
+		}
+	}
+
+	if (seed == 0)
+		seed = 1;
+
+	if (captures.empty()) {
+		captures.resize(kDS4TransportCount);
+		HostSynthesizeCapture(&captures[kDS4TransportUSB], kDS4TransportUSB, kDS4VariantV1, 5000);
+		HostSynthesizeCapture(&captures[kDS4TransportBluetooth], kDS4TransportBluetooth, kDS4VariantV1, 5000);
+	}
+
+	std::vector<DiffInput> recorded;
+	for (size_t c = 0; c < captures.size(); c++)
+		RecordedInputs(captures[c], &recorded);
+
+	printf("isa:");
+	for (int isa = 0; isa < kHostISACount; isa++)
+		printf(" %s%s", HostISANames[isa], HostSupportsISA((HostISA)isa) ? "" : "(unavailable)");
+	printf("\n");
+
+	unsigned long failures = 0;
+	for (size_t v = 0; v < kHostKernelVariantCount; v++) {
+		const HostKernelVariant *variant = &HostKernelVariants[v];
+		if (variant->isa == kHostISAScalar)
+			continue;
+
+		printf("%s/%s:", variant->kernel, HostISANames[variant->isa]);
+		if (variant->isa > HostDispatchLevel()) {
+			printf(" skipped\n");
+			continue;
+		}
+		printf("\n");
+
+		const HostKernelVariant *reference = HostKernelReference(variant->kernel);
+		unsigned reported = 0;
+		unsigned long randomFailures = 0, recordedFailures = 0;
+
+		// Every variant sees the same random sequence.
+		uint64_t state = seed;
+		for (unsigned long i = 0; i < iterations; i++) {
+			DiffInput input;
+			RandomInput(&state, &input);
+			randomFailures += !Compare(reference, variant, input, &reported);
+		}
+		for (size_t i = 0; i < recorded.size(); i++)
+			recordedFailures += !Compare(reference, variant, recorded[i], &reported);
+
+		printf("  %lu random, %lu mismatched; %zu recorded, %lu mismatched\n",
+			   iterations, randomFailures, recorded.size(), recordedFailures);
+		failures += randomFailures + recordedFailures;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+//
+//  ds4frames.cpp
+//  DS4 tools
+//
+//  Compares what a game sampling once per frame sees with the reports
+//  delivered as they arrive and with frame sync (DS4FrameResampler). For
+//  each frame rate it prints deliveries per second, how old the input is at
+//  each frame and how much that age jitters, and how many short button taps
+//  make it into a frame at all. Reports come from the given captures, or a
+//  synthetic one re-timed to --rate with up to --jitter of arrival noise; a
+//  one report tap of Square is injected every --tap-every reports.
+//
+//	ds4frames [--rate hz] [--jitter us] [--tap-every n] [--fps list] [capture ...]
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+
+#include "DS4HostPipeline.h"
+#include "DS4Resampler.h"
+
+struct FrameReport {
+	uint64_t	time;
+	uint16_t	length;
+	bool		tap;
+	uint8_t		bytes[DS4TransportTraits<kDS4TransportBluetooth>::kReportLength];
+};
+
+struct AgeStats {
+	double		sum;
+	double		squares;
+	double		max;
+	unsigned	count;
+
+	AgeStats() : sum(0), squares(0), max(0), count(0) {}
+
+	void add(double value)
+	{
+		sum += value;
+		squares += value * value;
+		if (value > max)
+			max = value;
+		count++;
+	}
+
+	double mean(void) const		{ return count ? sum / count : 0; }
+	double deviation(void) const
+	{
+		double m = mean();
+		return count ? sqrt(fmax(0, squares / count - m * m)) : 0;
+	}
+};
+
+static inline uint64_t XorShift(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+static bool SquareDown(const uint8_t *report, unsigned payload)
+{
+	return (report[payload + kDS4OffsetButtons] & 0x10) != 0;
+}
+
+// Copies the input reports out of a capture, optionally re-timed, with taps
+// of Square written in. Square is forced up everywhere else so the taps are
+// the only presses.
+static void LoadReports(const HostCapture &capture, uint64_t interval, uint64_t jitter, unsigned tapEvery,
+						std::vector<FrameReport> *reports)
+{
+	const unsigned payload = (capture.transport == kDS4TransportUSB) ? 1 : 3;
+	const uint16_t length = (capture.transport == kDS4TransportUSB) ? (uint16_t)DS4TransportTraits<kDS4TransportUSB>::kReportLength
+																	: (uint16_t)DS4TransportTraits<kDS4TransportBluetooth>::kReportLength;
+	uint64_t rng = 0x2545F4914F6CDD1DULL;
+
+	for (size_t r = 0; r < capture.records.size(); r++) {
+		const DS4CaptureRecord &record = capture.records[r];
+		if (record.direction != kDS4CaptureInput || record.length < length)
+			continue;
+
+		FrameReport report;
+		size_t index = reports->size();
+		report.time = interval ? index * interval + (jitter ? XorShift(&rng) % jitter : 0) : record.timestamp;
+		report.length = length;
+		report.tap = tapEvery != 0 && index % tapEvery == tapEvery / 2;
+		memcpy(report.bytes, record.bytes, length);
+
+		uint8_t *buttons = report.bytes + payload + kDS4OffsetButtons;
+		*buttons = (uint8_t)((*buttons & ~0x10) | (report.tap ? 0x10 : 0));
+		if (capture.transport == kDS4TransportBluetooth) {
+			uint32_t crc = DS4CRC32(kDS4CRC32SeedInput, report.bytes, length - 4);
+			for (int b = 0; b < 4; b++)
+				report.bytes[length - 4 + b] = (uint8_t)(crc >> (8 * b));
+		}
+
+		if (!reports->empty() && report.time < reports->back().time)
+			report.time = reports->back().time;
+		reports->push_back(report);
+	}
+}
+
+static void Compare(const char *name, DS4Transport transport, const std::vector<FrameReport> &reports,
+					const std::vector<double> &rates, uint64_t delay)
+{
+	if (reports.size() < 2)
+		return;
+
+	const unsigned payload = (transport == kDS4TransportUSB) ? 1 : 3;
+	const double seconds = (double)(reports.back().time - reports.front().time) / 1e9;
+	unsigned taps = 0;
+	for (size_t r = 0; r < reports.size(); r++)
+		taps += reports[r].tap;
+
+	printf("%s: %zu reports over %.2f s, %u taps, sampled %.2f ms behind frame sync\n",
+		   name, reports.size(), seconds, taps, (double)delay / 1e6);
+
+	for (size_t f = 0; f < rates.size(); f++) {
+		uint64_t period = (uint64_t)(1e9 / rates[f]);
+		AgeStats nativeAge, syncAge;
+		unsigned nativeTaps = 0, syncTaps = 0, frames = 0;
+		bool nativeDown = false, syncDown = false;
+		size_t next = 0;
+		static DS4FrameResampler resampler;
+		uint8_t out[DS4TransportTraits<kDS4TransportBluetooth>::kReportLength];
+
+		resampler.reset(transport, period, reports.front().time, delay);
+		for (uint64_t frame = resampler.nextFrame(reports.front().time + delay); frame <= reports.back().time;
+			 frame = resampler.nextFrame(frame)) {
+			while (next < reports.size() && reports[next].time <= frame) {
+				resampler.push(reports[next].bytes, reports[next].length, reports[next].time);
+				next++;
+			}
+			if (next == 0)
+				continue;
+			frames++;
+
+			// Delivered as they arrive, a game sees whatever came in last.
+			const FrameReport &latest = reports[next - 1];
+			nativeAge.add((double)(frame - latest.time) / 1e6);
+			bool down = SquareDown(latest.bytes, payload);
+			nativeTaps += down && !nativeDown;
+			nativeDown = down;
+
+			// With frame sync input is sampled a fixed delay behind the frame,
+			// and a tap lands in the frame after it whenever it came in.
+			if (resampler.frame(frame, out)) {
+				syncAge.add((double)delay / 1e6);
+				down = SquareDown(out, payload);
+				syncTaps += down && !syncDown;
+				syncDown = down;
+			}
+		}
+
+		printf("  %6.1f fps  %-10s %8.0f/s  age %6.2f ms  jitter %5.2f ms  max %6.2f ms  taps %u/%u\n",
+			   rates[f], "arrival", reports.size() / seconds, nativeAge.mean(), nativeAge.deviation(),
+			   nativeAge.max, nativeTaps, taps);
+		printf("  %6.1f fps  %-10s %8.0f/s  age %6.2f ms  jitter %5.2f ms  max %6.2f ms  taps %u/%u\n",
+			   rates[f], "frame sync", frames / seconds, syncAge.mean(), syncAge.deviation(),
+			   syncAge.max, syncTaps, taps);
+	}
+}
+
+static void Usage(void)
+{
+	fprintf(stderr, "usage: ds4frames [--rate hz] [--jitter us] [--tap-every n] [--fps list] [capture ...]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned rate = 250, jitterUS = 0, tapEvery = 37;
+	std::vector<double> fps;
+	std::vector<const char *> files;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+			rate = (unsigned)atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--jitter") && i + 1 < argc) {
+			jitterUS = (unsigned)atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--tap-every") && i + 1 < argc) {
+			tapEvery = (unsigned)atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--fps") && i + 1 < argc) {
+			for (char *rest = argv[++i]; *rest != '\0'; ) {
+				char *end;
+				double value = strtod(rest, &end);
+				if (end == rest || value <= 0)
+					Usage();
+				fps.push_back(value);
+				rest = (*end == ',') ? end + 1 : end;
+			}
+		} else if (argv[i][0] == '-') {
+			Usage();
+		} else {
+			files.push_back(argv[i]);
+		}
+	}
+
+	if (rate == 0)
+		Usage();
+	if (fps.empty()) {
+		fps.push_back(60);
+		fps.push_back(120);
+		fps.push_back(144);
+	}
+
+	if (files.empty()) {
+		HostCapture capture;
+		std::vector<FrameReport> reports;
+		HostSynthesizeCapture(&capture, kDS4TransportUSB, kDS4VariantV1, 2000);
+		LoadReports(capture, 1000000000ULL / rate, jitterUS * 1000ULL, tapEvery, &reports);
+		Compare("synthetic", kDS4TransportUSB, reports, fps, 3 * (1000000000ULL / rate) / 2);
+		return 0;
+	}
+
+	for (size_t i = 0; i < files.size(); i++) {
+		HostCapture capture;
+		std::vector<FrameReport> reports;
+		if (!capture.load(files[i])) {
+			fprintf(stderr, "ds4frames: could not read %s\n", files[i]);
+			return 1;
+		}
+		LoadReports(capture, 0, 0, tapEvery, &reports);
+		Compare(files[i], capture.transport, reports, fps,
+				3 * (1000000000ULL / DS4Variants[capture.variant].reportRateHz) / 2);
+	}
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+//
+//  ds4history.cpp
+//  DS4 tools
+//
+//  Runs DS4InputHistory the way the driver and its clients do: one thread
+//  records states, as handleReport does, while reader threads query it the
+//  way rollback code would, for the state at a time a few frames back, the
+//  entry for a report counter, and the button edges between two times. Every
+//  state recorded can be rebuilt from its index, so each answer is checked;
+//  a torn or misplaced entry is counted as wrong and fails the run. Entries
+//  overwritten before a reader got to them are counted as missed.
+//
+//  The writer records --rate reports a second, or as fast as it can with 0,
+//  which is the worst case for readers. Times are the report period apart
+//  whatever the real rate, so lookups always land on a known entry. --skip
+//  starts the history as if that many reports had already been recorded,
+//  to run the queries on indexes past 32 bits.
+//
+//	ds4history [--seconds s] [--readers n] [--rate hz] [--period us] [--skip n]
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "DS4InputHistory.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct ReaderStats {
+	uint64_t	lookups;
+	uint64_t	missed;
+	uint64_t	wrong;
+	uint64_t	edges;
+	double		ns;
+
+	ReaderStats() : lookups(0), missed(0), wrong(0), edges(0), ns(0) {}
+};
+
+static inline uint64_t XorShift(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+static void StateFor(uint64_t index, DS4State *state)
+{
+	uint64_t hash = (index + 1) * 0x9E3779B97F4A7C15ULL;
+
+	memset(state, 0, sizeof(*state));
+	state->leftX = (uint8_t)hash;
+	state->leftY = (uint8_t)(hash >> 8);
+	state->rightX = (uint8_t)(hash >> 16);
+	state->rightY = (uint8_t)(hash >> 24);
+	state->counter = (uint8_t)(index & 0x3F);
+	state->buttons = (index / 7) & 0x3FFF;
+	state->virtualButtons = (index / 13) & 0xFF;
+	state->hat = kDS4HatReleased;
+	for (int i = 0; i < 3; i++) {
+		state->gyro[i] = (int16_t)(hash >> (16 * i));
+		state->accel[i] = (int16_t)~(hash >> (16 * i));
+	}
+}
+
+static bool Matches(const DS4HistoryEntry &entry, uint64_t index, uint64_t period)
+{
+	DS4State expected;
+	StateFor(index, &expected);
+	return entry.index == index && entry.time == (index + 1) * period && entry.counter == index &&
+		   memcmp(&entry.state, &expected, sizeof(expected)) == 0;
+}
+
+static void Write(DS4InputHistory *history, std::atomic<bool> *running, unsigned rate, uint64_t period)
+{
+	Clock::time_point start = Clock::now();
+	uint64_t first = history->count();
+	DS4State state;
+
+	for (uint64_t index = first; running->load(std::memory_order_relaxed); index++) {
+		if (rate != 0)
+			std::this_thread::sleep_until(start + std::chrono::nanoseconds((index - first) * 1000000000ULL / rate));
+		StateFor(index, &state);
+		history->record(&state, (index + 1) * period);
+	}
+}
+
+static void Read(const DS4InputHistory *history, std::atomic<bool> *running, uint64_t period, uint64_t seed,
+				 ReaderStats *stats)
+{
+	uint64_t rng = seed;
+	DS4HistoryEntry entry;
+	double ns = 0;
+
+	while (running->load(std::memory_order_relaxed)) {
+		uint64_t head = history->count();
+		if (head < 2)
+			continue;
+
+		// Somewhere in the newest three quarters of the ring.
+		uint64_t held = head < kDS4HistorySlots ? head : kDS4HistorySlots;
+		uint64_t target = head - 1 - XorShift(&rng) % (held * 3 / 4);
+		if (target < 8)
+			continue;
+		uint64_t t = (target + 1) * period + XorShift(&rng) % period;
+		uint32_t pressed[2], released[2];
+		bool found;
+
+		Clock::time_point before = Clock::now();
+		switch (stats->lookups % 3) {
+			case 0:
+				found = history->stateAt(t, &entry);
+				break;
+			case 1:
+				found = history->atCounter(target, &entry);
+				break;
+			default:
+				found = history->edges(t - 8 * period, t, pressed, released);
+				break;
+		}
+		ns += std::chrono::duration<double, std::nano>(Clock::now() - before).count();
+
+		if (!found) {
+			stats->missed++;
+		} else if (stats->lookups % 3 == 2) {
+			// Edges over the eight reports after the one at t - 8 periods.
+			uint32_t expected[2][2] = { { 0, 0 }, { 0, 0 } };
+			DS4State last, now;
+			StateFor(target - 8, &last);
+			for (uint64_t i = target - 7; i <= target; i++) {
+				StateFor(i, &now);
+				expected[0][0] |= now.buttons & ~last.buttons;
+				expected[0][1] |= now.virtualButtons & ~last.virtualButtons;
+				expected[1][0] |= last.buttons & ~now.buttons;
+				expected[1][1] |= last.virtualButtons & ~now.virtualButtons;
+				last = now;
+			}
+			if (memcmp(expected[0], pressed, sizeof(pressed)) != 0)
+				stats->wrong++;
+			if (memcmp(expected[1], released, sizeof(released)) != 0)
+				stats->wrong++;
+			stats->edges += (pressed[0] | pressed[1] | released[0] | released[1]) != 0;
+		} else if (!Matches(entry, target, period)) {
+			stats->wrong++;
+		}
+		stats->lookups++;
+	}
+
+	stats->ns = stats->lookups ? ns / (double)stats->lookups : 0;
+}
+
+static void Usage(void)
+{
+	fprintf(stderr, "usage: ds4history [--seconds s] [--readers n] [--rate hz] [--period us] [--skip n]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = 2;
+	unsigned readers = 3, rate = 0, periodUS = 4000;
+	uint64_t skip = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--seconds") && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--readers") && i + 1 < argc)
+			readers = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--rate") && i + 1 < argc)
+			rate = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--period") && i + 1 < argc)
+			periodUS = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--skip") && i + 1 < argc)
+			skip = strtoull(argv[++i], NULL, 0);
+		else
+			Usage();
+	}
+
+	if (seconds <= 0 || readers == 0 || periodUS == 0)
+		Usage();
+
+	static DS4InputHistory history;
+	std::atomic<bool> running(true);
+	std::vector<ReaderStats> stats(readers);
+	std::vector<std::thread> threads;
+	uint64_t period = periodUS * 1000ULL;
+
+	history.reset();
+	if (skip != 0) {
+		history.head = skip;
+		history.lastCounter = skip - 1;
+	}
+	threads.push_back(std::thread(Write, &history, &running, rate, period));
+	for (unsigned i = 0; i < readers; i++)
+		threads.push_back(std::thread(Read, &history, &running, period, 0x2545F4914F6CDD1DULL + i * 2, &stats[i]));
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	running.store(false);
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	printf("%u slots of %zu bytes, %llu records at %s, %u readers\n", kDS4HistorySlots, sizeof(DS4HistorySlot),
+		   (unsigned long long)(history.count() - skip), rate ? "the given rate" : "full speed", readers);
+	printf("%-8s %12s %10s %8s %10s %10s\n", "reader", "lookups", "missed", "wrong", "with edges", "ns/lookup");
+
+	uint64_t wrong = 0;
+	for (unsigned i = 0; i < readers; i++) {
+		printf("%-8u %12llu %10llu %8llu %10llu %10.1f\n", i, (unsigned long long)stats[i].lookups,
+			   (unsigned long long)stats[i].missed, (unsigned long long)stats[i].wrong,
+			   (unsigned long long)stats[i].edges, stats[i].ns);
+		wrong += stats[i].wrong;
+	}
+
+	return wrong ? 1 : 0;
+}
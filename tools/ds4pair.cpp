@@ -0,0 +1,304 @@
+//
+//  ds4pair.cpp
+//  DS4 tools
+//
+//  Drives DS4PairingStation against a mock USB transport to measure how many
+//  pads a pairing station gets through per minute. Each mock pad answers
+//  0x12 with its address and current host and takes a new host and link key
+//  from 0x13, after a simulated transfer time. Time is simulated, so results
+//  are exact and repeatable; the host CPU time the station itself costs is
+//  printed alongside.
+//
+//  Every run pairs the same pads twice: serially, one pad at a time as a
+//  tool calling getFeatureReport in a loop would, and pipelined, with every
+//  pad's next transfer submitted as soon as its last one completes. Up to
+//  --lanes transfers run at once, standing in for how many the host
+//  controller and hubs keep going in parallel.
+//
+//	ds4pair [--pads n] [--lanes n] [--get-ms ms] [--set-ms ms] [--fail-rate p]
+//	        [--stubborn n] [--retries n] [--known] [--seed n]
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <queue>
+#include <vector>
+
+#include "DS4Pairing.h"
+
+#define kPairTransferFailed		(-1)	//	Stands in for a stall or timeout
+
+struct MockPad {
+	uint8_t		mac[6];
+	uint8_t		host[6];
+	uint8_t		key[kDS4LinkKeyLength];
+	bool		stubborn;		//	Acknowledges 0x13 but keeps its old host
+};
+
+struct Transfer {
+	uint64_t	done;
+	unsigned	pad;
+	bool		failed;
+
+	bool operator>(const Transfer &other) const	{ return done > other.done; }
+};
+
+struct Options {
+	unsigned	pads;
+	unsigned	lanes;
+	double		getMS;
+	double		setMS;
+	double		failRate;
+	unsigned	stubborn;
+	unsigned	retries;
+	bool		known;
+	uint64_t	seed;
+};
+
+struct Result {
+	unsigned	paired;
+	unsigned	failed;
+	unsigned	wrong;			//	Reported paired but the mock pad disagrees
+	uint64_t	transfers;
+	uint64_t	errors;			//	Transfers that failed and were retried or gave up
+	uint64_t	elapsed;		//	Simulated, ns
+	double		cpuNS;			//	Host time spent in the station, per transfer
+	std::vector<uint64_t> padTimes;
+
+	Result() : paired(0), failed(0), wrong(0), transfers(0), errors(0), elapsed(0), cpuNS(0) {}
+};
+
+static inline uint64_t XorShift(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+// Transfer time with +-25% jitter.
+static uint64_t Latency(uint64_t *state, double ms)
+{
+	double jitter = 0.75 + (double)(XorShift(state) % 1001) / 2000.0;
+	return (uint64_t)(ms * jitter * 1000000.0);
+}
+
+static void MockGet(const MockPad &mock, uint8_t *buffer)
+{
+	buffer[0] = kDS4FeaturePairingInfo;
+	memcpy(buffer + 1, mock.mac, 6);
+	buffer[7] = 0x08;
+	buffer[8] = 0x25;
+	buffer[9] = 0x00;
+	memcpy(buffer + 10, mock.host, 6);
+}
+
+static void MockSet(MockPad *mock, const uint8_t *buffer)
+{
+	if (mock->stubborn || buffer[0] != kDS4FeatureSetPairing)
+		return;
+	memcpy(mock->host, buffer + 1, 6);
+	memcpy(mock->key, buffer + 7, kDS4LinkKeyLength);
+}
+
+// window is how many pads are worked on at once: 1 for serial, all of them
+// for pipelined.
+static Result Run(const Options &options, unsigned window, const uint8_t hostMAC[6], const uint8_t linkKey[kDS4LinkKeyLength])
+{
+	uint64_t rng = options.seed;
+	std::vector<MockPad> mocks(options.pads);
+	std::vector<DS4PairingPad> pads(options.pads);
+	DS4PairingStation station;
+	Result result;
+
+	station.reset(hostMAC, linkKey, options.retries);
+
+	for (unsigned i = 0; i < options.pads; i++) {
+		MockPad &mock = mocks[i];
+		uint64_t r = XorShift(&rng);
+		mock.mac[0] = (uint8_t)i;
+		mock.mac[1] = (uint8_t)(i >> 8);
+		memcpy(mock.mac + 2, &r, 4);
+		memset(mock.host, 0, sizeof(mock.host));
+		memset(mock.key, 0, sizeof(mock.key));
+		mock.stubborn = i < options.stubborn;
+	}
+
+	std::priority_queue<Transfer, std::vector<Transfer>, std::greater<Transfer> > inFlight;
+	std::deque<unsigned> ready;
+	unsigned admitted = 0, finished = 0;
+	uint64_t now = 0;
+	double cpu = 0;
+
+	typedef std::chrono::steady_clock Clock;
+
+	while (finished < options.pads) {
+		Clock::time_point before = Clock::now();
+
+		while (admitted < options.pads && admitted - finished < window) {
+			DS4DeviceIdentity known;
+			memset(&known, 0, sizeof(known));
+			memcpy(known.mac, mocks[admitted].mac, 6);
+			known.flags = kDS4IdentityHasMAC;
+			station.begin(&pads[admitted], now, options.known ? &known : NULL);
+			ready.push_back(admitted++);
+		}
+
+		while (!ready.empty() && inFlight.size() < options.lanes) {
+			unsigned i = ready.front();
+			DS4PairingRequest request;
+			ready.pop_front();
+			if (!station.next(&pads[i], &request))
+				continue;
+
+			Transfer transfer;
+			transfer.pad = i;
+			transfer.failed = options.failRate > 0 && (double)(XorShift(&rng) % 1000000) / 1000000.0 < options.failRate;
+			transfer.done = now + Latency(&rng, request.direction == kDS4PairingGetReport ? options.getMS : options.setMS);
+			inFlight.push(transfer);
+			result.transfers++;
+		}
+
+		cpu += std::chrono::duration<double, std::nano>(Clock::now() - before).count();
+		if (inFlight.empty())
+			break;
+
+		Transfer transfer = inFlight.top();
+		inFlight.pop();
+		now = transfer.done;
+
+		DS4PairingPad *pad = &pads[transfer.pad];
+		size_t length = 0;
+		if (!transfer.failed) {
+			if (pad->step == kDS4PairingWriteLinkKey) {
+				MockSet(&mocks[transfer.pad], pad->buffer);
+				length = kDS4SetPairingLength;
+			} else {
+				MockGet(mocks[transfer.pad], pad->buffer);
+				length = kDS4PairingInfoLength;
+			}
+		} else {
+			result.errors++;
+		}
+
+		before = Clock::now();
+		station.complete(pad, transfer.failed ? kPairTransferFailed : 0, length, now);
+		cpu += std::chrono::duration<double, std::nano>(Clock::now() - before).count();
+
+		if (!DS4PairingStation::done(pad)) {
+			ready.push_back(transfer.pad);
+			continue;
+		}
+
+		finished++;
+		if (pad->step == kDS4PairingPaired) {
+			const MockPad &mock = mocks[transfer.pad];
+			result.paired++;
+			if (memcmp(mock.host, hostMAC, 6) != 0 || memcmp(mock.key, linkKey, kDS4LinkKeyLength) != 0)
+				result.wrong++;
+		} else {
+			result.failed++;
+		}
+		result.padTimes.push_back(pad->finished - pad->started);
+	}
+
+	result.elapsed = now;
+	result.cpuNS = result.transfers ? cpu / (double)result.transfers : 0;
+	std::sort(result.padTimes.begin(), result.padTimes.end());
+	return result;
+}
+
+static double Percentile(const std::vector<uint64_t> &sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	return (double)sorted[(size_t)(p * (double)(sorted.size() - 1))] / 1000000.0;
+}
+
+static void Print(const char *mode, const Result &r)
+{
+	double minutes = (double)r.elapsed / 60e9;
+	double rate = minutes > 0 ? r.paired / minutes : 0;
+
+	printf("%-10s %7u %7u %7u %10llu %8llu %10.1f %11.1f %9.1f %9.1f %8.0f\n",
+		   mode, r.paired, r.failed, r.wrong, (unsigned long long)r.transfers,
+		   (unsigned long long)r.errors, (double)r.elapsed / 1e6, rate,
+		   Percentile(r.padTimes, 0.5), Percentile(r.padTimes, 0.99), r.cpuNS);
+}
+
+static void Usage(void)
+{
+	fprintf(stderr, "usage: ds4pair [--pads n] [--lanes n] [--get-ms ms] [--set-ms ms] [--fail-rate p]\n"
+					"               [--stubborn n] [--retries n] [--known] [--seed n]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	Options options;
+	options.pads = 64;
+	options.lanes = 8;
+	options.getMS = 1.0;
+	options.setMS = 12.0;
+	options.failRate = 0;
+	options.stubborn = 0;
+	options.retries = 2;
+	options.known = false;
+	options.seed = 0x9E3779B97F4A7C15ULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--pads") && i + 1 < argc)
+			options.pads = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--lanes") && i + 1 < argc)
+			options.lanes = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--get-ms") && i + 1 < argc)
+			options.getMS = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--set-ms") && i + 1 < argc)
+			options.setMS = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--fail-rate") && i + 1 < argc)
+			options.failRate = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--stubborn") && i + 1 < argc)
+			options.stubborn = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--retries") && i + 1 < argc)
+			options.retries = (unsigned)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--known"))
+			options.known = true;
+		else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+			options.seed = strtoull(argv[++i], NULL, 0) | 1;
+		else
+			Usage();
+	}
+
+	if (options.pads == 0 || options.lanes == 0 || options.getMS < 0 || options.setMS < 0)
+		Usage();
+
+	static const uint8_t kHostMAC[6] = { 0x66, 0x55, 0x44, 0x33, 0x22, 0x11 };
+	uint8_t linkKey[kDS4LinkKeyLength];
+	uint64_t rng = options.seed;
+	for (unsigned i = 0; i < kDS4LinkKeyLength; i++)
+		linkKey[i] = (uint8_t)XorShift(&rng);
+
+	printf("%u pads, %u lanes, get %.1f ms, set %.1f ms, fail rate %.3f, %u retries%s\n",
+		   options.pads, options.lanes, options.getMS, options.setMS, options.failRate,
+		   options.retries, options.known ? ", identity known" : "");
+	printf("%-10s %7s %7s %7s %10s %8s %10s %11s %9s %9s %8s\n",
+		   "mode", "paired", "failed", "wrong", "transfers", "errors", "total ms",
+		   "pads/min", "p50 ms", "p99 ms", "cpu ns");
+
+	Result serial = Run(options, 1, kHostMAC, linkKey);
+	Result pipelined = Run(options, options.pads, kHostMAC, linkKey);
+	Print("serial", serial);
+	Print("pipelined", pipelined);
+
+	if (pipelined.elapsed > 0)
+		printf("speedup %.1fx\n", (double)serial.elapsed / (double)pipelined.elapsed);
+
+	return (serial.wrong || pipelined.wrong) ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+//
+//  ds4replay.cpp
+//  DS4 tools
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+//  Replays captures through the host pipeline and prints a digest of
+//  everything it produced for each one: decoded state, virtual buttons and
+//  axes, the translated report and pointer output. Captures are replayed in
+//  parallel. With --write the digests are saved to a file, and with --check
+//  they are compared against one, so a change to any stage can be checked
+//  for bit exactness. Without captures the built-in synthetic ones are used.
+//
+//	ds4replay [--jobs n] [--mode name] [--write file | --check file] [capture ...]
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DS4CRC32.h"
+#include "DS4HostPipeline.h"
+
+struct Replay {
+	HostCapture		capture;
+	uint32_t		digest;
+	uint64_t		reports;
+};
+
+// Fields are fed in one at a time, little endian, so the digest does not
+// depend on struct padding or host byte order.
+struct Digest {
+	uint32_t	crc;
+
+	Digest() : crc(0xFFFFFFFF) {}
+
+	void add(const uint8_t *bytes, size_t length)
+	{
+		crc = DS4CRC32Update(crc, bytes, length);
+	}
+
+	void add(uint32_t value, int length)
+	{
+		uint8_t bytes[4];
+		for (int i = 0; i < length; i++)
+			bytes[i] = (uint8_t)(value >> (8 * i));
+		add(bytes, length);
+	}
+
+	void add(const DS4State &state)
+	{
+		add(state.leftX, 1);
+		add(state.leftY, 1);
+		add(state.rightX, 1);
+		add(state.rightY, 1);
+		add(state.l2, 1);
+		add(state.r2, 1);
+		add(state.hat, 1);
+		add(state.counter, 1);
+		add(state.buttons, 4);
+		add(state.timestamp, 2);
+		for (int axis = 0; axis < 3; axis++) {
+			add((uint16_t)state.gyro[axis], 2);
+			add((uint16_t)state.accel[axis], 2);
+		}
+		add(state.battery, 1);
+		add(state.padPresent, 1);
+		add(state.touchPacket, 1);
+		for (int i = 0; i < kDS4TouchCount; i++) {
+			add(state.touch[i].active, 1);
+			add(state.touch[i].id, 1);
+			add(state.touch[i].x, 2);
+			add(state.touch[i].y, 2);
+		}
+		add(state.virtualButtons, 4);
+		for (int i = 0; i < kDS4VirtualAxisCount; i++)
+			add((uint16_t)state.virtualAxes[i], 2);
+	}
+};
+
+static DS4ReportMode gMode = kDS4ReportModeNative;
+
+static void RunReplay(Replay *replay)
+{
+	HostPipeline pipeline;
+	Digest digest;
+
+	pipeline.reset(replay->capture.transport, replay->capture.variant, gMode);
+
+	for (size_t r = 0; r < replay->capture.records.size(); r++) {
+		const DS4CaptureRecord &record = replay->capture.records[r];
+		if (record.direction != kDS4CaptureInput)
+			continue;
+
+		pipeline.process(record);
+
+		digest.add(pipeline.state);
+		if (pipeline.mode->reportLength != 0)
+			digest.add(pipeline.modeReport, pipeline.mode->reportLength);
+		digest.add(pipeline.pointer.buttons, 1);
+		digest.add((uint8_t)pipeline.pointer.dx, 1);
+		digest.add((uint8_t)pipeline.pointer.dy, 1);
+		replay->reports++;
+	}
+
+	for (int i = 0; i < kDS4CounterCount; i++)
+		digest.add((uint32_t)pipeline.counters.get((DS4Counter)i), 4);
+
+	replay->digest = ~digest.crc;
+}
+
+static bool ReadGoldens(const char *path, std::map<std::string, uint32_t> *goldens)
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL)
+		return false;
+
+	char line[1024], name[1000];
+	unsigned digest;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%8x %*u %999s", &digest, name) == 2)
+			(*goldens)[name] = digest;
+	}
+	fclose(fp);
+
+	return true;
+}
+
+static void Usage(void)
+{
+	fprintf(stderr, "usage: ds4replay [--jobs n] [--mode name] [--write file | --check file] [capture ...]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned jobs = std::thread::hardware_concurrency();
+	const char *writePath = NULL, *checkPath = NULL;
+	std::vector<Replay> replays;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--jobs") && i + 1 < argc) {
+			jobs = (unsigned)atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--mode") && i + 1 < argc) {
+			const DS4ReportModeInfo *mode = DS4LookupReportMode(argv[++i]);
+			if (mode == NULL)
+				Usage();
+			gMode = (DS4ReportMode)(mode - DS4ReportModes);
+		} else if (!strcmp(argv[i], "--write") && i + 1 < argc) {
+			writePath = argv[++i];
+		} else if (!strcmp(argv[i], "--check") && i + 1 < argc) {
+			checkPath = argv[++i];
+		} else if (argv[i][0] == '-') {
+			Usage();
+		} else {
+			replays.push_back(Replay());
+			if (!replays.back().capture.load(argv[i])) {
+				fprintf(stderr, "ds4replay: cannot read capture %s\n", argv[i]);
+				return 1;
+			}
+		}
+	}
+
+	if (replays.empty()) {
+		replays.resize(kDS4TransportCount);
+		HostSynthesizeCapture(&replays[kDS4TransportUSB].capture, kDS4TransportUSB, kDS4VariantV1, 5000);
+		HostSynthesizeCapture(&replays[kDS4TransportBluetooth].capture, kDS4TransportBluetooth, kDS4VariantV1, 5000);
+		replays[kDS4TransportUSB].capture.path = "synthetic-usb";
+		replays[kDS4TransportBluetooth].capture.path = "synthetic-bt";
+	}
+
+	// Each worker takes the next capture until none are left.
+	if (jobs == 0)
+		jobs = 1;
+	if (jobs > replays.size())
+		jobs = (unsigned)replays.size();
+
+	size_t next = 0;
+	std::vector<std::thread> workers;
+	for (unsigned j = 0; j < jobs; j++) {
+		workers.push_back(std::thread([&replays, &next]() {
+			size_t i;
+			while ((i = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED)) < replays.size())
+				RunReplay(&replays[i]);
+		}));
+	}
+	for (size_t j = 0; j < workers.size(); j++)
+		workers[j].join();
+
+	std::map<std::string, uint32_t> goldens;
+	if (checkPath != NULL && !ReadGoldens(checkPath, &goldens)) {
+		fprintf(stderr, "ds4replay: cannot read %s\n", checkPath);
+		return 1;
+	}
+
+	FILE *out = stdout;
+	if (writePath != NULL && (out = fopen(writePath, "w")) == NULL) {
+		fprintf(stderr, "ds4replay: cannot write %s\n", writePath);
+		return 1;
+	}
+
+	int failures = 0;
+	for (size_t i = 0; i < replays.size(); i++) {
+		const Replay &replay = replays[i];
+		fprintf(out, "%08x %llu %s\n", replay.digest, (unsigned long long)replay.reports, replay.capture.path.c_str());
+
+		if (checkPath != NULL) {
+			std::map<std::string, uint32_t>::const_iterator golden = goldens.find(replay.capture.path);
+			if (golden == goldens.end()) {
+				fprintf(stderr, "ds4replay: no golden for %s\n", replay.capture.path.c_str());
+				failures++;
+			} else if (golden->second != replay.digest) {
+				fprintf(stderr, "ds4replay: %s digest %08x, expected %08x\n",
+						replay.capture.path.c_str(), replay.digest, golden->second);
+				failures++;
+			}
+		}
+	}
+
+	if (out != stdout)
+		fclose(out);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+//
+//  ds4trace.cpp
+//  DS4 tools
+//
+//  Copyright (c) 2015 Little Black Hat. All rights reserved.
+//
+//  Converts DS4Trace exports (the DS4Trace registry property saved to a file)
+//  into Chrome trace event JSON, which chrome://tracing and the Perfetto UI
+//  both open. Each pad becomes a process with one track for the input path
+//  and one for output.
+//
+//	ds4trace export ... > trace.json
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "DS4Trace.h"
+
+static const char *const kStageNames[kDS4TraceStageCount] = {
+	"arrival",
+	"decode",
+	"filter",
+	"dispatch",
+	"output submit",
+	"output complete"
+};
+
+static bool ReadFile(const char *path, std::vector<uint8_t> *bytes)
+{
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL)
+		return false;
+
+	uint8_t chunk[4096];
+	size_t got;
+	while ((got = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+		bytes->insert(bytes->end(), chunk, chunk + got);
+	fclose(fp);
+
+	return true;
+}
+
+static uint64_t ReadLE(const uint8_t *p, int length)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < length; i++)
+		value |= (uint64_t)p[i] << (8 * i);
+	return value;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: ds4trace export ... > trace.json\n");
+		return 2;
+	}
+
+	bool first = true;
+	printf("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+
+	for (int f = 1; f < argc; f++) {
+		std::vector<uint8_t> bytes;
+		if (!ReadFile(argv[f], &bytes)) {
+			fprintf(stderr, "ds4trace: cannot read %s\n", argv[f]);
+			return 1;
+		}
+
+		if (bytes.size() < kDS4TraceExportHeaderLength || bytes[0] != 'D' || bytes[1] != 'S' ||
+			bytes[2] != '4' || bytes[3] != 'T' || ReadLE(&bytes[4], 2) != kDS4TraceExportVersion) {
+			fprintf(stderr, "ds4trace: %s is not a DS4 trace export\n", argv[f]);
+			return 1;
+		}
+
+		unsigned pad = (unsigned)ReadLE(&bytes[6], 2);
+		uint64_t count = ReadLE(&bytes[8], 4);
+		if (kDS4TraceExportHeaderLength + count * kDS4TraceExportEventLength > bytes.size()) {
+			fprintf(stderr, "ds4trace: %s is truncated\n", argv[f]);
+			return 1;
+		}
+
+		printf("%s\n{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": %u, \"args\": {\"name\": \"DS4 %s\"}}",
+			   first ? "" : ",", pad, argv[f]);
+		printf(",\n{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": %u, \"tid\": 1, \"args\": {\"name\": \"input\"}}", pad);
+		printf(",\n{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": %u, \"tid\": 2, \"args\": {\"name\": \"output\"}}", pad);
+		first = false;
+
+		for (uint64_t i = 0; i < count; i++) {
+			const uint8_t *e = &bytes[kDS4TraceExportHeaderLength + i * kDS4TraceExportEventLength];
+			uint64_t begin = ReadLE(e, 8);
+			uint64_t duration = ReadLE(e + 8, 4);
+			unsigned sequence = (unsigned)ReadLE(e + 12, 2);
+			unsigned stage = e[14];
+
+			if (stage >= kDS4TraceStageCount)
+				continue;
+
+			unsigned tid = (stage >= kDS4TraceOutputSubmit) ? 2 : 1;
+			if (stage == kDS4TraceArrival) {
+				printf(",\n{\"ph\": \"i\", \"s\": \"t\", \"name\": \"%s\", \"pid\": %u, \"tid\": %u, \"ts\": %.3f, \"args\": {\"sequence\": %u}}",
+					   kStageNames[stage], pad, tid, begin / 1000.0, sequence);
+			} else {
+				printf(",\n{\"ph\": \"X\", \"name\": \"%s\", \"pid\": %u, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"sequence\": %u}}",
+					   kStageNames[stage], pad, tid, begin / 1000.0, duration / 1000.0, sequence);
+			}
+		}
+	}
+
+	printf("\n]}\n");
+	return 0;
+}